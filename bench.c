@@ -0,0 +1,771 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Micro-benchmarks for the 65C02 core. Each workload is a small loop of
+ * code in a flat 64K RAM, run for a fixed number of instructions.
+ * Also runs conformance checks and test images against the core */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include "cpu_65c02.h"
+
+struct _workload_t {
+	const char *name;
+	const uint8_t *code;
+	int len;
+	const uint8_t *zp;	/* Initial zero page, $00-$3F */
+};
+
+/* ALU, immediate operands */
+static const uint8_t _alu[] = {
+	0xA9, 0x12,		/* LDA #$12  */
+	0x69, 0x34,		/* ADC #$34  */
+	0x49, 0x55,		/* EOR #$55  */
+	0x29, 0xF0,		/* AND #$F0  */
+	0x09, 0x0F,		/* ORA #$0F  */
+	0xE9, 0x01,		/* SBC #$01  */
+	0x0A,			/* ASL A     */
+	0x6A,			/* ROR A     */
+	0xE8,			/* INX       */
+	0x88,			/* DEY       */
+	0xC9, 0x80,		/* CMP #$80  */
+	0x4C, 0x00, 0x02,	/* JMP $0200 */
+};
+
+/* Taken and not taken branches */
+static const uint8_t _branch[] = {
+	0xA2, 0x00,		/* LDX #$00      */
+	0xE8,			/* INX           */
+	0xE0, 0x40,		/* CPX #$40      */
+	0x90, 0xFB,		/* BCC $0202     */
+	0xCA,			/* DEX           */
+	0xD0, 0xFD,		/* BNE $0207     */
+	0xF0, 0xF4,		/* BEQ $0200     */
+};
+
+/* Zero page loads, stores and arithmetic */
+static const uint8_t _zeropage[] = {
+	0xA5, 0x10,		/* LDA $10   */
+	0x85, 0x11,		/* STA $11   */
+	0xE6, 0x12,		/* INC $12   */
+	0xA6, 0x13,		/* LDX $13   */
+	0x86, 0x14,		/* STX $14   */
+	0x65, 0x15,		/* ADC $15   */
+	0xB5, 0x16,		/* LDA $16,X */
+	0x95, 0x17,		/* STA $17,X */
+	0xA4, 0x18,		/* LDY $18   */
+	0x84, 0x19,		/* STY $19   */
+	0x4C, 0x00, 0x02,	/* JMP $0200 */
+};
+
+/* Copy through ($zp),Y pointers */
+static const uint8_t _indirect[] = {
+	0xA0, 0x00,		/* LDY #$00      */
+	0xB1, 0x20,		/* LDA ($20),Y   */
+	0x91, 0x22,		/* STA ($22),Y   */
+	0x71, 0x20,		/* ADC ($20),Y   */
+	0xC8,			/* INY           */
+	0xD0, 0xF7,		/* BNE $0202     */
+	0x4C, 0x00, 0x02,	/* JMP $0200     */
+};
+
+/* Decimal mode ADC and SBC */
+static const uint8_t _bcd[] = {
+	0xF8,			/* SED       */
+	0x18,			/* CLC       */
+	0xA9, 0x19,		/* LDA #$19  */
+	0x69, 0x28,		/* ADC #$28  */
+	0xE9, 0x09,		/* SBC #$09  */
+	0x65, 0x30,		/* ADC $30   */
+	0x38,			/* SEC       */
+	0xE5, 0x31,		/* SBC $31   */
+	0xD8,			/* CLD       */
+	0x4C, 0x00, 0x02,	/* JMP $0200 */
+};
+
+/* Subroutine calls and the stack */
+static const uint8_t _stack[] = {
+	0x20, 0x10, 0x02,	/* JSR $0210 */
+	0x48,			/* PHA       */
+	0xDA,			/* PHX       */
+	0x5A,			/* PHY       */
+	0x7A,			/* PLY       */
+	0xFA,			/* PLX       */
+	0x68,			/* PLA       */
+	0x08,			/* PHP       */
+	0x28,			/* PLP       */
+	0x4C, 0x00, 0x02,	/* JMP $0200 */
+	0xEA, 0xEA, 0xEA,	/* NOP       */
+	0xEA, 0xEA,		/* NOP       */
+	0x5A,			/* PHY       ; $0210 */
+	0x20, 0x18, 0x02,	/* JSR $0218 */
+	0x7A,			/* PLY       */
+	0x60,			/* RTS       */
+	0xEA, 0xEA,		/* NOP       */
+	0x60,			/* RTS       ; $0218 */
+};
+
+/* Read-modify-write */
+static const uint8_t _rmw[] = {
+	0xE6, 0x40,		/* INC $40       */
+	0xC6, 0x41,		/* DEC $41       */
+	0x06, 0x42,		/* ASL $42       */
+	0x66, 0x43,		/* ROR $43       */
+	0xFE, 0x00, 0x04,	/* INC $0400,X   */
+	0x07, 0x44,		/* RMB0 $44      */
+	0x97, 0x44,		/* SMB1 $44      */
+	0x04, 0x45,		/* TSB $45       */
+	0x14, 0x46,		/* TRB $46       */
+	0xE8,			/* INX           */
+	0x4C, 0x00, 0x02,	/* JMP $0200     */
+};
+
+static const uint8_t _zp_data[0x40] = {
+	[0x10] = 0x5A, 0x00, 0x80, 0x03, 0x00, 0x7F, 0x01,
+	[0x20] = 0x00, 0x10, 0x00, 0x20,
+	[0x30] = 0x45, 0x17,
+};
+
+static const struct _workload_t _workloads[] = {
+	{ "alu",      _alu,      sizeof(_alu),      _zp_data },
+	{ "branch",   _branch,   sizeof(_branch),   _zp_data },
+	{ "zeropage", _zeropage, sizeof(_zeropage), _zp_data },
+	{ "indirect", _indirect, sizeof(_indirect), _zp_data },
+	{ "bcd",      _bcd,      sizeof(_bcd),      _zp_data },
+	{ "stack",    _stack,    sizeof(_stack),    _zp_data },
+	{ "rmw",      _rmw,      sizeof(_rmw),      _zp_data },
+	{ NULL }
+};
+
+/* Base cycle counts from the WDC W65C02S datasheet, for no page
+ * crossing and conditional branches not taken */
+static const uint8_t _ref_cycles[0x100] = {
+	7, 6, 2, 1, 5, 3, 5, 5, 3, 2, 2, 1, 6, 4, 6, 5, /* 0x0x */
+	2, 5, 5, 1, 5, 4, 6, 5, 2, 4, 2, 1, 6, 4, 6, 5, /* 0x1x */
+	6, 6, 2, 1, 3, 3, 5, 5, 4, 2, 2, 1, 4, 4, 6, 5, /* 0x2x */
+	2, 5, 5, 1, 4, 4, 6, 5, 2, 4, 2, 1, 4, 4, 6, 5, /* 0x3x */
+	6, 6, 2, 1, 3, 3, 5, 5, 3, 2, 2, 1, 3, 4, 6, 5, /* 0x4x */
+	2, 5, 5, 1, 4, 4, 6, 5, 2, 4, 3, 1, 8, 4, 6, 5, /* 0x5x */
+	6, 6, 2, 1, 3, 3, 5, 5, 4, 2, 2, 1, 6, 4, 6, 5, /* 0x6x */
+	2, 5, 5, 1, 4, 4, 6, 5, 2, 4, 4, 1, 6, 4, 6, 5, /* 0x7x */
+	3, 6, 2, 1, 3, 3, 3, 5, 2, 2, 2, 1, 4, 4, 4, 5, /* 0x8x */
+	2, 6, 5, 1, 4, 4, 4, 5, 2, 5, 2, 1, 4, 5, 5, 5, /* 0x9x */
+	2, 6, 2, 1, 3, 3, 3, 5, 2, 2, 2, 1, 4, 4, 4, 5, /* 0xAx */
+	2, 5, 5, 1, 4, 4, 4, 5, 2, 4, 2, 1, 4, 4, 4, 5, /* 0xBx */
+	2, 6, 2, 1, 3, 3, 5, 5, 2, 2, 2, 3, 4, 4, 6, 5, /* 0xCx */
+	2, 5, 5, 1, 4, 4, 6, 5, 2, 4, 3, 3, 4, 4, 7, 5, /* 0xDx */
+	2, 6, 2, 1, 3, 3, 5, 5, 2, 2, 2, 1, 4, 4, 6, 5, /* 0xEx */
+	2, 5, 5, 1, 4, 4, 6, 5, 2, 4, 4, 1, 4, 4, 7, 5, /* 0xFx */
+};
+
+/* Length of the reserved opcodes, which the W65C02S runs as NOPs, or 0 */
+static int _reserved_length(uint8_t op)
+{
+	if((op & 0x0F) == 0x03 || ((op & 0x0F) == 0x0B && op != 0xCB && op != 0xDB))
+	{
+		return(1);
+	}
+	
+	if(((op & 0x1F) == 0x02 && op != 0xA2) || op == 0x44 || op == 0x54 || op == 0xD4 || op == 0xF4)
+	{
+		return(2);
+	}
+	
+	if(op == 0x5C || op == 0xDC || op == 0xFC)
+	{
+		return(3);
+	}
+	
+	return(0);
+}
+
+struct _result_t {
+	double mean;
+	double stddev;
+	double min;
+	double cycles;
+};
+
+static uint8_t _ram[0x10000];
+
+static uint8_t _ram_read(void *private, uint16_t addr)
+{
+	return(_ram[addr]);
+}
+
+static void _ram_write(void *private, uint16_t addr, uint8_t v)
+{
+	_ram[addr] = v;
+}
+
+static double _now(void)
+{
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	return(ts.tv_sec * 1e9 + ts.tv_nsec);
+}
+
+static void _run(const struct _workload_t *w, struct cpu_memory_t *mem, long n, int repeats, struct _result_t *r)
+{
+	struct cpu_65c02_t cpu;
+	double ns, sum = 0, sum2 = 0;
+	long i;
+	int j;
+	
+	r->min = INFINITY;
+	
+	for(j = 0; j < repeats; j++)
+	{
+		/* Fresh memory and CPU each time */
+		memset(_ram, 0, sizeof(_ram));
+		memcpy(_ram, w->zp, 0x40);
+		memcpy(&_ram[0x0200], w->code, w->len);
+		_ram[0xFFFC] = 0x00;
+		_ram[0xFFFD] = 0x02;
+		
+		cpu_65c02_init(&cpu, 1000000, 1, mem);
+		
+		ns = _now();
+		
+		for(i = 0; i < n; i++)
+		{
+			cpu_65c02_exec(&cpu);
+		}
+		
+		ns = (_now() - ns) / n;
+		
+		sum += ns;
+		sum2 += ns * ns;
+		if(ns < r->min) r->min = ns;
+		
+		r->cycles = (double) cpu.cycle / n;
+	}
+	
+	r->mean = sum / repeats;
+	r->stddev = sqrt(fmax(sum2 / repeats - r->mean * r->mean, 0));
+}
+
+static int _check_cycles(struct cpu_memory_t *mem)
+{
+	struct cpu_65c02_t cpu;
+	int errors = 0;
+	int op;
+	
+	for(op = 0x00; op <= 0xFF; op++)
+	{
+		/* Operands point at $0010 / $10, which points at $0300.
+		 * X and Y are 0 so nothing crosses a page */
+		memset(_ram, 0, sizeof(_ram));
+		_ram[0x0010] = 0x00;
+		_ram[0x0011] = 0x03;
+		_ram[0x0200] = op;
+		_ram[0x0201] = 0x10;
+		_ram[0x0202] = 0x00;
+		_ram[0xFFFC] = 0x00;
+		_ram[0xFFFD] = 0x02;
+		
+		cpu_65c02_init(&cpu, 1000000, 1, mem);
+		
+		if((op & 0x1F) == 0x10)
+		{
+			/* Set up the flags so a conditional branch isn't taken.
+			 * Bits 6-7 select N, V, C or Z, bit 5 branches if set */
+			static const uint8_t flag[4] = { 0x80, 0x40, 0x01, 0x02 };
+			cpu_65c02_set_status(&cpu, op & 0x20 ? 0x00 : flag[op >> 6]);
+		}
+		
+		cpu_65c02_exec(&cpu);
+		
+		if(cpu.cycle != _ref_cycles[op])
+		{
+			printf("cycles: $%02X %-4s took %lu, expected %d\n",
+				op, cpu_65c02_mnemonic(op), cpu.cycle, _ref_cycles[op]);
+			errors++;
+		}
+		
+		if(cpu.faults & CPU_FAULT_OPCODE)
+		{
+			printf("cycles: $%02X is not implemented\n", op);
+			errors++;
+		}
+		
+		if(_reserved_length(op) && cpu.pc != 0x0200 + _reserved_length(op))
+		{
+			printf("cycles: $%02X reserved NOP is %d bytes, expected %d\n",
+				op, cpu.pc - 0x0200, _reserved_length(op));
+			errors++;
+		}
+	}
+	
+	printf("cycles: %d mismatches\n", errors);
+	
+	return(errors ? -1 : 0);
+}
+
+/* WAI holds until an interrupt, masked or not, and STP ignores them */
+static int _check_wait(struct cpu_memory_t *mem)
+{
+	struct cpu_65c02_t cpu;
+	int errors = 0;
+	int i, masked;
+	
+	for(masked = 0; masked < 2; masked++)
+	{
+		/* WAI, STP, and an RTI handler */
+		memset(_ram, 0, sizeof(_ram));
+		_ram[0x0200] = 0xCB;
+		_ram[0x0201] = 0xDB;
+		_ram[0x0300] = 0x40;
+		_ram[0xFFFC] = 0x00;
+		_ram[0xFFFD] = 0x02;
+		_ram[0xFFFE] = 0x00;
+		_ram[0xFFFF] = 0x03;
+		
+		cpu_65c02_init(&cpu, 1000000, 1, mem);
+		cpu.i = masked;
+		
+		for(i = 0; i < 5; i++)
+		{
+			cpu_65c02_exec(&cpu);
+		}
+		
+		if(cpu.pc != 0x0200 || cpu.cycle != 3 + 4)
+		{
+			printf("wait: WAI at $%04X after %lu cycles, expected $0200 after 7\n", cpu.pc, cpu.cycle);
+			errors++;
+		}
+		
+		cpu_65c02_irq(&cpu, 0);
+		if(!masked) cpu_65c02_exec(&cpu);
+		
+		if(cpu.pc != 0x0201)
+		{
+			printf("wait: %s interrupt left WAI for $%04X, expected $0201\n", masked ? "masked" : "an", cpu.pc);
+			errors++;
+		}
+		
+		cpu_65c02_exec(&cpu);
+		cpu_65c02_irq(&cpu, 1);
+		cpu_65c02_exec(&cpu);
+		
+		if(cpu.pc != 0x0201 || cpu.wait != 2)
+		{
+			printf("wait: STP left for $%04X\n", cpu.pc);
+			errors++;
+		}
+	}
+	
+	printf("wait: %d mismatches\n", errors);
+	
+	return(errors ? -1 : 0);
+}
+
+/* Decimal ADC and SBC of every pair of valid BCD operands, with and
+ * without carry, against the sum worked out in binary */
+static int _check_decimal(struct cpu_memory_t *mem)
+{
+	struct cpu_65c02_t cpu;
+	int errors = 0;
+	int op, a, m, c, n;
+	uint8_t r;
+	
+	for(op = 0; op < 2; op++)
+	{
+		for(a = 0; a < 100; a++)
+		{
+			for(m = 0; m < 100; m++)
+			{
+				for(c = 0; c < 2; c++)
+				{
+					/* ADC #m or SBC #m */
+					_ram[0x0200] = op ? 0xE9 : 0x69;
+					_ram[0x0201] = (m / 10) << 4 | (m % 10);
+					
+					cpu_65c02_init(&cpu, 1000000, 1, mem);
+					cpu.pc = 0x0200;
+					cpu.a = (a / 10) << 4 | (a % 10);
+					cpu.c = c;
+					cpu.d = 1;
+					
+					cpu_65c02_exec(&cpu);
+					
+					n = op ? a - m - 1 + c : a + m + c;
+					r = ((n + 100) % 100 / 10) << 4 | ((n + 100) % 10);
+					
+					if(cpu.a != r || cpu.c != (op ? n >= 0 : n > 99) ||
+					   (cpu_65c02_status(&cpu) & 0x82) != ((r & 0x80) | (r ? 0 : 0x02)))
+					{
+						if(errors++ < 16)
+						{
+							printf("decimal: %02d %s %02d, carry %d gave %02X C%d, expected %02X\n",
+								a, op ? "-" : "+", m, c, cpu.a, cpu.c, r);
+						}
+					}
+				}
+			}
+		}
+	}
+	
+	printf("decimal: %d mismatches\n", errors);
+	
+	return(errors ? -1 : 0);
+}
+
+/* A main loop polling RAM that an interrupt handler sets every fourth
+ * time, then waiting on a timer read through a handler. Run with idle
+ * loops skipped and without, both must agree at every interrupt */
+static const uint8_t _idle_main[] = {
+	0x58,             /* CLI           */
+	0xA5, 0x80,       /* LDA $80       */
+	0xF0, 0xFC,       /* BEQ $0201     */
+	0x64, 0x80,       /* STZ $80       */
+	0xE6, 0x81,       /* INC $81       */
+	0xAD, 0x00, 0xE0, /* LDA $E000     */
+	0xCD, 0x00, 0xE0, /* CMP $E000     */
+	0xF0, 0xFB,       /* BEQ $020C     */
+	0x80, 0xEE,       /* BRA $0201     */
+};
+
+static const uint8_t _idle_irq[] = {
+	0x48,             /* PHA           */
+	0xE6, 0x82,       /* INC $82       */
+	0xA5, 0x82,       /* LDA $82       */
+	0x29, 0x03,       /* AND #$03      */
+	0xD0, 0x02,       /* BNE $030B     */
+	0xE6, 0x80,       /* INC $80       */
+	0x68,             /* PLA           */
+	0x40,             /* RTI           */
+};
+
+struct _idle_t {
+	struct cpu_memory_t mem;
+	struct cpu_65c02_t cpu;
+	uint8_t ram[0x10000];
+};
+
+static uint8_t _idle_read(void *private, uint16_t addr)
+{
+	struct _idle_t *s = private;
+	
+	if(addr == 0xE000)
+	{
+		/* A free running timer */
+		s->cpu.volatile_reads++;
+		return(s->cpu.cycle / 300);
+	}
+	
+	return(s->ram[addr]);
+}
+
+static void _idle_write(void *private, uint16_t addr, uint8_t v)
+{
+	struct _idle_t *s = private;
+	
+	s->ram[addr] = v;
+}
+
+static int _check_idle(void)
+{
+	static struct _idle_t m[2];
+	uint64_t next;
+	int errors = 0;
+	int i, j;
+	
+	for(i = 0; i < 2; i++)
+	{
+		memset(&m[i], 0, sizeof(struct _idle_t));
+		memcpy(&m[i].ram[0x0200], _idle_main, sizeof(_idle_main));
+		memcpy(&m[i].ram[0x0300], _idle_irq, sizeof(_idle_irq));
+		m[i].ram[0xFFFC] = 0x00;
+		m[i].ram[0xFFFD] = 0x02;
+		m[i].ram[0xFFFE] = 0x00;
+		m[i].ram[0xFFFF] = 0x03;
+		
+		m[i].mem.private = &m[i];
+		m[i].mem.read = &_idle_read;
+		m[i].mem.write = &_idle_write;
+		cpu_memory_map(&m[i].mem, 0x0000, 0xE000, m[i].ram, m[i].ram);
+		cpu_memory_map(&m[i].mem, 0xE100, 0x1F00, m[i].ram + 0xE100, m[i].ram + 0xE100);
+		
+		cpu_65c02_init(&m[i].cpu, 1000000, 1, &m[i].mem);
+	}
+	
+	for(j = 1; j <= 1000 && errors < 16; j++)
+	{
+		/* An interrupt every 1000 cycles, m[0] skipping idle loops */
+		next = j * 1000;
+		
+		for(i = 0; i < 2; i++)
+		{
+			while(m[i].cpu.cycle < next)
+			{
+				cpu_65c02_exec(&m[i].cpu);
+				if(i == 0) cpu_65c02_idle_skip(&m[i].cpu, next);
+			}
+			
+			cpu_65c02_irq(&m[i].cpu, 0);
+		}
+		
+		if(m[0].cpu.cycle != m[1].cpu.cycle ||
+		   m[0].cpu.pc != m[1].cpu.pc ||
+		   m[0].cpu.writes != m[1].cpu.writes ||
+		   memcmp(m[0].ram, m[1].ram, 0x400) != 0)
+		{
+			printf("idle: differs at interrupt %d, cycle %lu/%lu, pc $%04X/$%04X\n",
+				j, m[0].cpu.cycle, m[1].cpu.cycle, m[0].cpu.pc, m[1].cpu.pc);
+			errors++;
+		}
+	}
+	
+	if(m[0].cpu.idle_skipped == 0)
+	{
+		printf("idle: no loop was skipped\n");
+		errors++;
+	}
+	
+	printf("idle: %d mismatches, %lu cycles skipped\n", errors, m[0].cpu.idle_skipped);
+	
+	return(errors ? -1 : 0);
+}
+
+static int _run_image(struct cpu_memory_t *mem, const char *filename, long load, long start, long success, long error, long limit)
+{
+	struct cpu_65c02_t cpu;
+	uint16_t pc;
+	long i;
+	FILE *f;
+	
+	memset(_ram, 0, sizeof(_ram));
+	
+	f = fopen(filename, "rb");
+	if(!f)
+	{
+		perror(filename);
+		return(-1);
+	}
+	
+	i = fread(&_ram[load], 1, 0x10000 - load, f);
+	fclose(f);
+	
+	printf("image: loaded %ld bytes at $%04lX\n", i, load);
+	
+	cpu_65c02_init(&cpu, 1000000, 1, mem);
+	
+	if(start >= 0)
+	{
+		cpu.pc = start;
+	}
+	
+	/* Test images finish by jumping or branching to themselves */
+	for(i = 0; i < limit; i++)
+	{
+		pc = cpu.pc;
+		cpu_65c02_exec(&cpu);
+		
+		if(cpu.pc == pc)
+		{
+			break;
+		}
+	}
+	
+	printf("image: %s at $%04X after %ld instructions, %lu cycles\n",
+		i == limit ? "stopped" : "trapped", cpu.pc, i, cpu.cycle);
+	printf("image: A:%02X X:%02X Y:%02X SP:%02X P:%02X\n",
+		cpu.a, cpu.x, cpu.y, cpu.sp, cpu_65c02_status(&cpu));
+	
+	if(error >= 0)
+	{
+		printf("image: error byte $%04lX = $%02X\n", error, _ram[error]);
+		
+		if(_ram[error] != 0)
+		{
+			return(-1);
+		}
+	}
+	
+	if(success >= 0 && cpu.pc != success)
+	{
+		printf("image: FAILED, expected to finish at $%04lX\n", success);
+		return(-1);
+	}
+	
+	return(0);
+}
+
+static void _json_string(FILE *f, const char *s)
+{
+	/* Quoted, with the characters JSON doesn't allow raw escaped */
+	fputc('"', f);
+	
+	for(; *s; s++)
+	{
+		if(*s == '"' || *s == '\\') fprintf(f, "\\%c", *s);
+		else if((unsigned char) *s < 0x20) fprintf(f, "\\u%04X", (unsigned char) *s);
+		else fputc(*s, f);
+	}
+	
+	fputc('"', f);
+}
+
+static void _usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options] [workload ...]\n"
+		"\n"
+		"  -n <count>  Instructions per run (default 5000000)\n"
+		"  -r <count>  Runs per workload (default 5)\n"
+		"  -m          Access memory through the handlers, not the page map\n"
+		"  -o <file>   Write the results as JSON\n"
+		"  -l <label>  Label stored in the JSON, e.g. the commit\n"
+		"\n"
+		"Conformance:\n"
+		"\n"
+		"  -c          Check instruction cycle counts against the W65C02S datasheet,\n"
+		"              the reserved NOPs, WAI and STP,\n"
+		"              decimal mode ADC and SBC results, and that skipping idle\n"
+		"              loops doesn't change a run with interrupts\n"
+		"  -i <file>   Run a test image, such as the Klaus Dormann 6502/65C02\n"
+		"              functional or decimal tests, until it traps\n"
+		"  -a <addr>   Load address for the image (default $0000)\n"
+		"  -p <addr>   Start address (default the reset vector)\n"
+		"  -t <addr>   Address of the success trap\n"
+		"  -e <addr>   Address of an error byte that must be zero at the end\n",
+		name
+	);
+}
+
+int main(int argc, char *argv[])
+{
+	static struct cpu_memory_t mem;
+	struct _result_t r[sizeof(_workloads) / sizeof(*_workloads)];
+	const struct _workload_t *w;
+	const char *output = NULL;
+	const char *label = "";
+	const char *image = NULL;
+	long load = 0x0000, start = -1, success = -1, error = -1;
+	long n = 5000000;
+	int repeats = 5;
+	int handlers = 0;
+	int check = 0;
+	int first;
+	FILE *f;
+	int c, i;
+	
+	while((c = getopt(argc, argv, "n:r:mo:l:ci:a:p:t:e:")) != -1)
+	{
+		switch(c)
+		{
+		case 'n': n = atol(optarg); break;
+		case 'r': repeats = atoi(optarg); break;
+		case 'm': handlers = 1; break;
+		case 'o': output = optarg; break;
+		case 'l': label = optarg; break;
+		case 'c': check = 1; break;
+		case 'i': image = optarg; break;
+		case 'a': load = strtol(optarg, NULL, 0) & 0xFFFF; break;
+		case 'p': start = strtol(optarg, NULL, 0) & 0xFFFF; break;
+		case 't': success = strtol(optarg, NULL, 0) & 0xFFFF; break;
+		case 'e': error = strtol(optarg, NULL, 0) & 0xFFFF; break;
+		default: _usage(argv[0]); return(-1);
+		}
+	}
+	
+	if(n <= 0 || repeats <= 0)
+	{
+		_usage(argv[0]);
+		return(-1);
+	}
+	
+	mem.read = &_ram_read;
+	mem.write = &_ram_write;
+	
+	if(!handlers)
+	{
+		cpu_memory_map(&mem, 0x0000, 0x10000, _ram, _ram);
+	}
+	
+	if(check || image)
+	{
+		if(check && (_check_cycles(&mem) != 0 || _check_wait(&mem) != 0 ||
+		             _check_decimal(&mem) != 0 || _check_idle() != 0))
+		{
+			return(1);
+		}
+		
+		if(image && _run_image(&mem, image, load, start, success, error, n * 100) != 0)
+		{
+			return(1);
+		}
+		
+		return(0);
+	}
+	
+	printf("%-10s %10s %10s %10s %8s\n", "workload", "ns/ins", "stddev", "min", "cyc/ins");
+	
+	for(i = 0, w = _workloads; w->name; i++, w++)
+	{
+		r[i].mean = -1;
+		
+		/* Run only the named workloads, if any */
+		if(optind < argc)
+		{
+			for(c = optind; c < argc && strcmp(argv[c], w->name) != 0; c++);
+			if(c == argc) continue;
+		}
+		
+		_run(w, &mem, n, repeats, &r[i]);
+		
+		printf("%-10s %10.3f %10.3f %10.3f %8.3f\n", w->name, r[i].mean, r[i].stddev, r[i].min, r[i].cycles);
+	}
+	
+	if(output)
+	{
+		f = fopen(output, "w");
+		if(!f)
+		{
+			perror(output);
+			return(-1);
+		}
+		
+		fprintf(f, "{\n  \"label\": ");
+		_json_string(f, label);
+		fprintf(f, ",\n  \"instructions\": %ld,\n  \"repeats\": %d,\n  \"handlers\": %s,\n  \"results\": {",
+			n, repeats, handlers ? "true" : "false");
+		
+		for(i = 0, first = 1, w = _workloads; w->name; i++, w++)
+		{
+			if(r[i].mean < 0) continue;
+			
+			fprintf(f, "%s\n    \"%s\": { \"ns_per_ins\": %.4f, \"stddev\": %.4f, \"min\": %.4f, \"cycles_per_ins\": %.4f }",
+				first ? "" : ",", w->name, r[i].mean, r[i].stddev, r[i].min, r[i].cycles);
+			first = 0;
+		}
+		
+		fprintf(f, "\n  }\n}\n");
+		fclose(f);
+	}
+	
+	return(0);
+}
+
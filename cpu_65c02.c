@@ -20,6 +20,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include "cpu_65c02.h"
+#include "profile.h"
+#include "log.h"
 
 enum _addr_mode_t {
 	_invalid,
@@ -52,6 +54,10 @@ enum _addr_mode_t {
 
 /* Emulator flags */
 #define _PB (1 << 8)	/* Add cycle for page crossed */
+#define _RMW (1 << 9)	/* Read-modify-write, the read is two cycles before the write */
+
+/* Longest backwards jump considered for idle loop detection */
+#define _IDLE_LOOP_MAX 64
 
 struct _instr_t {
 	const char *m;
@@ -68,36 +74,36 @@ static const struct _instr_t _instrs[0x100] =
 	{ "ORA",  _zp_indirect_x, 2, 6, _Z | _N },
 	{ "",     _invalid,       2, 2 },
 	{ "",     _invalid,       1, 1 },
-	{ "TSB",  _zp,            2, 5, _Z },
+	{ "TSB",  _zp,            2, 5, _Z | _RMW },
 	{ "ORA",  _zp,            2, 3, _Z | _N },
-	{ "ASL",  _zp,            2, 5, _Z | _N | _C },
-	{ "RMB0", _zp,            2, 5 },
+	{ "ASL",  _zp,            2, 5, _Z | _N | _C | _RMW },
+	{ "RMB0", _zp,            2, 5, _RMW },
 	{ "PHP",  _implicit,      1, 3 },
 	{ "ORA",  _immediate,     2, 2, _Z | _N },
 	{ "ASL",  _a,             1, 2, _Z | _N | _C },
 	{ "",     _invalid,       1, 1 },
-	{ "TSB",  _absolute,      3, 6, _Z },
+	{ "TSB",  _absolute,      3, 6, _Z | _RMW },
 	{ "ORA",  _absolute,      3, 4, _Z | _N },
-	{ "ASL",  _absolute,      3, 6, _Z | _N | _C },
-	{ "BBR0", _zp_relative,   3, 4 },
+	{ "ASL",  _absolute,      3, 6, _Z | _N | _C | _RMW },
+	{ "BBR0", _zp_relative,   3, 5 },
 	
 	/* 0x1x */
 	{ "BPL",  _relative,      2, 2 },
 	{ "ORA",  _zp_indirect_y, 2, 5, _Z | _N | _PB },
 	{ "ORA",  _zp_indirect,   2, 5, _Z | _N },
 	{ "",     _invalid,       1, 1 },
-	{ "TRB",  _zp,            2, 5 },
+	{ "TRB",  _zp,            2, 5, _Z | _RMW },
 	{ "ORA",  _zp_x,          2, 4, _Z | _N },
-	{ "ASL",  _zp_x,          2, 6, _Z | _N | _C },
-	{ "RMB1", _zp,            2, 5 },
+	{ "ASL",  _zp_x,          2, 6, _Z | _N | _C | _RMW },
+	{ "RMB1", _zp,            2, 5, _RMW },
 	{ "CLC",  _implicit,      1, 2 },
 	{ "ORA",  _absolute_y,    3, 4, _Z | _N | _PB },
 	{ "INC",  _a,             1, 2, _Z | _N },
 	{ "",     _invalid,       1, 1 },
-	{ "TRB",  _absolute,      3, 6, _Z },
+	{ "TRB",  _absolute,      3, 6, _Z | _RMW },
 	{ "ORA",  _absolute_x,    3, 4, _Z | _N | _PB },
-	{ "ASL",  _absolute_x,    3, 6, _Z | _N | _C | _PB },
-	{ "BBR1", _zp_relative,   3, 4 },
+	{ "ASL",  _absolute_x,    3, 6, _Z | _N | _C | _PB | _RMW },
+	{ "BBR1", _zp_relative,   3, 5 },
 	
 	/* 0x2x */
 	{ "JSR",  _absolute,      3, 6 },
@@ -106,34 +112,34 @@ static const struct _instr_t _instrs[0x100] =
 	{ "",     _invalid,       1, 1 },
 	{ "BIT",  _zp,            2, 3, _Z },
 	{ "AND",  _zp,            2, 3, _Z | _N },
-	{ "ROL",  _zp,            2, 5, _Z | _N | _C },
-	{ "RMB2", _zp,            2, 5 },
+	{ "ROL",  _zp,            2, 5, _Z | _N | _C | _RMW },
+	{ "RMB2", _zp,            2, 5, _RMW },
 	{ "PLP",  _implicit,      1, 4 },
 	{ "AND",  _immediate,     2, 2, _Z | _N },
 	{ "ROL",  _a,             1, 2, _Z | _N | _C },
 	{ "",     _invalid,       1, 1 },
 	{ "BIT",  _absolute,      3, 4, _Z },
 	{ "AND",  _absolute,      3, 4, _Z | _N },
-	{ "ROL",  _absolute,      3, 6, _Z | _N | _C },
-	{ "BBR2", _zp_relative,   3, 4 },
+	{ "ROL",  _absolute,      3, 6, _Z | _N | _C | _RMW },
+	{ "BBR2", _zp_relative,   3, 5 },
 	
 	/* 0x3x */
 	{ "BMI",  _relative,      2, 2 },
-	{ "AND",  _zp_indirect_y, 2, 5, _Z | _N },
+	{ "AND",  _zp_indirect_y, 2, 5, _Z | _N | _PB },
 	{ "AND",  _zp_indirect,   2, 5, _Z | _N },
 	{ "",     _invalid,       1, 1 },
 	{ "BIT",  _zp_x,          2, 4, _Z },
 	{ "AND",  _zp_x,          2, 4, _Z | _N },
-	{ "ROL",  _zp_x,          2, 6, _Z | _N | _C },
-	{ "RMB3", _zp,            2, 5 },
+	{ "ROL",  _zp_x,          2, 6, _Z | _N | _C | _RMW },
+	{ "RMB3", _zp,            2, 5, _RMW },
 	{ "SEC",  _implicit,      1, 2 },
 	{ "AND",  _absolute_y,    3, 4, _Z | _N | _PB },
 	{ "DEC",  _a,             1, 2, _Z | _N },
 	{ "",     _invalid,       1, 1 },
 	{ "BIT",  _absolute_x,    3, 4, _Z | _PB },
 	{ "AND",  _absolute_x,    3, 4, _Z | _N | _PB },
-	{ "ROL",  _absolute_x,    3, 6, _N | _Z | _C | _PB },
-	{ "BBR3", _zp_relative,   3, 4 },
+	{ "ROL",  _absolute_x,    3, 6, _N | _Z | _C | _PB | _RMW },
+	{ "BBR3", _zp_relative,   3, 5 },
 	
 	/* 0x4x */
 	{ "RTI",  _implicit,      1, 6 },
@@ -142,16 +148,16 @@ static const struct _instr_t _instrs[0x100] =
 	{ "",     _invalid,       1, 1 },
 	{ "",     _invalid,       2, 3 },
 	{ "EOR",  _zp,            2, 3, _Z | _N },
-	{ "LSR",  _zp,            2, 5, _Z | _N | _C },
-	{ "RMB4", _zp,            2, 5 },
+	{ "LSR",  _zp,            2, 5, _Z | _N | _C | _RMW },
+	{ "RMB4", _zp,            2, 5, _RMW },
 	{ "PHA",  _implicit,      1, 3 },
 	{ "EOR",  _immediate,     2, 2, _Z | _N },
 	{ "LSR",  _a,             1, 2, _Z | _N | _C },
 	{ "",     _invalid,       1, 1 },
 	{ "JMP",  _absolute,      3, 3 },
 	{ "EOR",  _absolute,      3, 4, _Z | _N },
-	{ "LSR",  _absolute,      3, 6, _Z | _N | _C },
-	{ "BBR4", _zp_relative,   3, 4 },
+	{ "LSR",  _absolute,      3, 6, _Z | _N | _C | _RMW },
+	{ "BBR4", _zp_relative,   3, 5 },
 	
 	/* 0x5x */
 	{ "BVC",  _relative,      2, 2 },
@@ -160,88 +166,88 @@ static const struct _instr_t _instrs[0x100] =
 	{ "",     _invalid,       1, 1 },
 	{ "",     _invalid,       2, 4 },
 	{ "EOR",  _zp_x,          2, 4, _Z | _N },
-	{ "LSR",  _zp_x,          2, 6, _Z | _N },
-	{ "RMB5", _zp,            2, 5 },
+	{ "LSR",  _zp_x,          2, 6, _Z | _N | _RMW },
+	{ "RMB5", _zp,            2, 5, _RMW },
 	{ "CLI",  _implicit,      1, 2 },
 	{ "EOR",  _absolute_y,    3, 4, _Z | _N | _PB },
 	{ "PHY",  _implicit,      1, 3 },
 	{ "",     _invalid,       1, 1 },
 	{ "",     _invalid,       3, 8 },
 	{ "EOR",  _absolute_x,    3, 4, _Z | _N | _PB },
-	{ "LSR",  _absolute_x,    3, 6, _Z | _N | _C | _PB },
-	{ "BBR5", _zp_relative,   3, 4 },
+	{ "LSR",  _absolute_x,    3, 6, _Z | _N | _C | _PB | _RMW },
+	{ "BBR5", _zp_relative,   3, 5 },
 	
 	/* 0x6x */
 	{ "RTS",  _implicit,      1, 6 },
 	{ "ADC",  _zp_indirect_x, 2, 6, _N | _Z | _C | _V },
 	{ "",     _invalid,       2, 2 },
 	{ "",     _invalid,       1, 1 },
-	{ "STZ",  _zp,            2, 4 },
+	{ "STZ",  _zp,            2, 3 },
 	{ "ADC",  _zp,            2, 3, _N | _Z | _C | _V },
-	{ "ROR",  _zp,            2, 5, _Z | _N | _C },
-	{ "RMB6", _zp,            2, 5 },
+	{ "ROR",  _zp,            2, 5, _Z | _N | _C | _RMW },
+	{ "RMB6", _zp,            2, 5, _RMW },
 	{ "PLA",  _implicit,      1, 4, _N | _Z },
 	{ "ADC",  _immediate,     2, 2, _N | _Z | _C | _V },
 	{ "ROR",  _a,             1, 2, _Z | _N | _C },
 	{ "",     _invalid,       1, 1 },
 	{ "JMP",  _indirect,      3, 6 },
 	{ "ADC",  _absolute,      3, 4, _N | _Z | _C | _V },
-	{ "ROR",  _absolute,      3, 6, _Z | _N | _C },
-	{ "BBR6", _zp_relative,   3, 4 },
+	{ "ROR",  _absolute,      3, 6, _Z | _N | _C | _RMW },
+	{ "BBR6", _zp_relative,   3, 5 },
 	
 	/* 0x7x */
 	{ "BVS",  _relative,      2, 2 },
 	{ "ADC",  _zp_indirect_y, 2, 5, _N | _Z | _C | _V | _PB },
 	{ "ADC",  _zp_indirect,   2, 5, _N | _Z | _C | _V },
 	{ "",     _invalid,       1, 1 },
-	{ "STZ",  _zp_x,          2, 5 },
+	{ "STZ",  _zp_x,          2, 4 },
 	{ "ADC",  _zp_x,          2, 4, _N | _Z | _C | _V },
-	{ "ROR",  _zp_x,          2, 6, _Z | _N | _C },
-	{ "RMB7", _zp,            2, 5 },
+	{ "ROR",  _zp_x,          2, 6, _Z | _N | _C | _RMW },
+	{ "RMB7", _zp,            2, 5, _RMW },
 	{ "SEI",  _implicit,      1, 2 },
 	{ "ADC",  _absolute_y,    3, 4, _N | _Z | _C | _V | _PB },
 	{ "PLY",  _implicit,      1, 4, _N | _Z },
 	{ "",     _invalid,       1, 1 },
 	{ "JMP",  _indirect_x,    3, 6 },
 	{ "ADC",  _absolute_x,    3, 4, _N | _Z | _C | _V | _PB },
-	{ "ROR",  _absolute_x,    3, 6, _Z | _N | _C | _PB },
-	{ "BBR7", _zp_relative,   3, 4 },
+	{ "ROR",  _absolute_x,    3, 6, _Z | _N | _C | _PB | _RMW },
+	{ "BBR7", _zp_relative,   3, 5 },
 	
 	/* 0x8x */
 	{ "BRA",  _relative,      2, 2 },
-	{ "STA",  _zp_indirect_x, 2, 7 },
+	{ "STA",  _zp_indirect_x, 2, 6 },
 	{ "",     _invalid,       2, 2 },
 	{ "",     _invalid,       1, 1 },
-	{ "STY",  _zp,            2, 4 },
-	{ "STA",  _zp,            2, 4 },
-	{ "STX",  _zp,            2, 4 },
-	{ "SMB0", _zp,            2, 5 },
+	{ "STY",  _zp,            2, 3 },
+	{ "STA",  _zp,            2, 3 },
+	{ "STX",  _zp,            2, 3 },
+	{ "SMB0", _zp,            2, 5, _RMW },
 	{ "DEY",  _implicit,      1, 2, _N | _Z },
 	{ "BIT",  _immediate,     2, 2, _Z },
 	{ "TXA",  _implicit,      1, 2, _N | _Z },
 	{ "",     _invalid,       1, 1 },
-	{ "STY",  _absolute,      3, 5 },
-	{ "STA",  _absolute,      3, 5 },
-	{ "STX",  _absolute,      3, 5 },
-	{ "BBS0", _zp_relative,   3, 4 },
+	{ "STY",  _absolute,      3, 4 },
+	{ "STA",  _absolute,      3, 4 },
+	{ "STX",  _absolute,      3, 4 },
+	{ "BBS0", _zp_relative,   3, 5 },
 	
 	/* 0x9x */
 	{ "BCC",  _relative,      2, 2 },
-	{ "STA",  _zp_indirect_y, 2, 7 },
-	{ "STA",  _zp_indirect,   2, 6 },
+	{ "STA",  _zp_indirect_y, 2, 6 },
+	{ "STA",  _zp_indirect,   2, 5 },
 	{ "",     _invalid,       1, 1 },
-	{ "STY",  _zp_x,          2, 5 },
-	{ "STA",  _zp_x,          2, 5 },
-	{ "STX",  _zp_y,          2, 5 },
-	{ "SMB1", _zp,            2, 5 },
+	{ "STY",  _zp_x,          2, 4 },
+	{ "STA",  _zp_x,          2, 4 },
+	{ "STX",  _zp_y,          2, 4 },
+	{ "SMB1", _zp,            2, 5, _RMW },
 	{ "TYA",  _implicit,      1, 2, _Z | _N },
-	{ "STA",  _absolute_y,    3, 6 },
+	{ "STA",  _absolute_y,    3, 5 },
 	{ "TXS",  _implicit,      1, 2 },
 	{ "",     _invalid,       1, 1 },
-	{ "STZ",  _absolute,      3, 5 },
-	{ "STA",  _absolute_x,    3, 6 },
-	{ "STZ",  _absolute_x,    3, 6 },
-	{ "BBS1", _zp_relative,   3, 4 },
+	{ "STZ",  _absolute,      3, 4 },
+	{ "STA",  _absolute_x,    3, 5 },
+	{ "STZ",  _absolute_x,    3, 5 },
+	{ "BBS1", _zp_relative,   3, 5 },
 	
 	/* 0xAx */
 	{ "LDY",  _immediate,     2, 2, _Z | _N },
@@ -251,7 +257,7 @@ static const struct _instr_t _instrs[0x100] =
 	{ "LDY",  _zp,            2, 3, _Z | _N },
 	{ "LDA",  _zp,            2, 3, _Z | _N },
 	{ "LDX",  _zp,            2, 3, _Z | _N },
-	{ "SMB2", _zp,            2, 5 },
+	{ "SMB2", _zp,            2, 5, _RMW },
 	{ "TAY",  _implicit,      1, 2, _Z | _N },
 	{ "LDA",  _immediate,     2, 2, _Z | _N },
 	{ "TAX",  _implicit,      1, 2, _Z | _N },
@@ -259,7 +265,7 @@ static const struct _instr_t _instrs[0x100] =
 	{ "LDY",  _absolute,      3, 4, _Z | _N },
 	{ "LDA",  _absolute,      3, 4, _Z | _N },
 	{ "LDX",  _absolute,      3, 4, _Z | _N },
-	{ "BBS2", _zp_relative,   3, 4 },
+	{ "BBS2", _zp_relative,   3, 5 },
 	
 	/* 0xBx */
 	{ "BCS",  _relative,      2, 2 },
@@ -269,7 +275,7 @@ static const struct _instr_t _instrs[0x100] =
 	{ "LDY",  _zp_x,          2, 4, _Z | _N },
 	{ "LDA",  _zp_x,          2, 4, _Z | _N },
 	{ "LDX",  _zp_y,          2, 4, _Z | _N },
-	{ "SMB3", _zp,            2, 5 },
+	{ "SMB3", _zp,            2, 5, _RMW },
 	{ "CLV",  _implicit,      1, 2 },
 	{ "LDA",  _absolute_y,    3, 4, _Z | _N | _PB },
 	{ "TSX",  _implicit,      1, 2, _Z | _N },
@@ -277,7 +283,7 @@ static const struct _instr_t _instrs[0x100] =
 	{ "LDY",  _absolute_x,    3, 4, _Z | _N | _PB },
 	{ "LDA",  _absolute_x,    3, 4, _Z | _N | _PB },
 	{ "LDX",  _absolute_y,    3, 4, _Z | _N | _PB },
-	{ "BBS3", _zp_relative,   3, 4 },
+	{ "BBS3", _zp_relative,   3, 5 },
 	
 	/* 0xCx */
 	{ "CPY",  _immediate,     2, 2, _Z | _N | _C },
@@ -286,16 +292,16 @@ static const struct _instr_t _instrs[0x100] =
 	{ "",     _invalid,       1, 1 },
 	{ "CPY",  _zp,            2, 3, _Z | _N | _C },
 	{ "CMP",  _zp,            2, 3, _Z | _N | _C },
-	{ "DEC",  _zp,            2, 5, _Z | _N },
-	{ "SMB4", _zp,            2, 5 },
+	{ "DEC",  _zp,            2, 5, _Z | _N | _RMW },
+	{ "SMB4", _zp,            2, 5, _RMW },
 	{ "INY",  _implicit,      1, 2, _Z | _N },
 	{ "CMP",  _immediate,     2, 2, _Z | _N | _C },
 	{ "DEX",  _implicit,      1, 2, _Z | _N },
-	{ "WAI",  _implicit,      1, 5 },
+	{ "WAI",  _implicit,      1, 3 },
 	{ "CPY",  _absolute,      3, 4, _Z | _N | _C },
 	{ "CMP",  _absolute,      3, 4, _Z | _N | _C },
-	{ "DEC",  _absolute,      3, 6, _Z | _N },
-	{ "BBS4", _zp_relative,   3, 4 },
+	{ "DEC",  _absolute,      3, 6, _Z | _N | _RMW },
+	{ "BBS4", _zp_relative,   3, 5 },
 	
 	/* 0xDx */
 	{ "BNE",  _relative,      2, 2 },
@@ -304,16 +310,16 @@ static const struct _instr_t _instrs[0x100] =
 	{ "",     _invalid,       1, 1 },
 	{ "",     _invalid,       2, 4 },
 	{ "CMP",  _zp_x,          2, 4, _Z | _N | _C },
-	{ "DEC",  _zp_x,          2, 6, _Z | _N },
-	{ "SMB5", _zp,            2, 5 },
+	{ "DEC",  _zp_x,          2, 6, _Z | _N | _RMW },
+	{ "SMB5", _zp,            2, 5, _RMW },
 	{ "CLD",  _implicit,      1, 2 },
 	{ "CMP",  _absolute_y,    3, 4, _Z | _N | _C | _PB },
 	{ "PHX",  _implicit,      1, 3 },
-	{ "STP",  _implicit,      1, 2 },
+	{ "STP",  _implicit,      1, 3 },
 	{ "",     _invalid,       3, 4 },
 	{ "CMP",  _absolute_x,    3, 4, _Z | _N | _C | _PB },
-	{ "DEC",  _absolute_x,    3, 7, _Z | _N },
-	{ "BBS5", _zp_relative,   3, 4 },
+	{ "DEC",  _absolute_x,    3, 7, _Z | _N | _RMW },
+	{ "BBS5", _zp_relative,   3, 5 },
 	
 	/* 0xEx */
 	{ "CPX",  _immediate,     2, 2, _Z | _N | _C },
@@ -322,16 +328,16 @@ static const struct _instr_t _instrs[0x100] =
 	{ "",     _invalid,       1, 1 },
 	{ "CPX",  _zp,            2, 3, _Z | _N | _C },
 	{ "SBC",  _zp,            2, 3, _N | _Z | _C | _V },
-	{ "INC",  _zp,            2, 5, _Z | _N },
-	{ "SMB6", _zp,            2, 5 },
+	{ "INC",  _zp,            2, 5, _Z | _N | _RMW },
+	{ "SMB6", _zp,            2, 5, _RMW },
 	{ "INX",  _implicit,      1, 2, _Z | _N },
 	{ "SBC",  _immediate,     2, 2, _N | _Z | _C | _V },
 	{ "NOP",  _implicit,      1, 2 },
 	{ "",     _invalid,       1, 1 },
 	{ "CPX",  _absolute,      3, 4, _Z | _N | _C },
 	{ "SBC",  _absolute,      3, 4, _N | _Z | _C | _V },
-	{ "INC",  _absolute,      3, 6, _Z | _N },
-	{ "BBS6", _zp_relative,   3, 4 },
+	{ "INC",  _absolute,      3, 6, _Z | _N | _RMW },
+	{ "BBS6", _zp_relative,   3, 5 },
 	
 	/* 0xFx */
 	{ "BEQ",  _relative,      2, 2 },
@@ -340,52 +346,77 @@ static const struct _instr_t _instrs[0x100] =
 	{ "",     _invalid,       1, 1 },
 	{ "",     _invalid,       2, 4 },
 	{ "SBC",  _zp_x,          2, 4, _N | _Z | _C | _V },
-	{ "INC",  _zp_x,          2, 6, _Z | _N },
-	{ "SMB7", _zp,            2, 5 },
+	{ "INC",  _zp_x,          2, 6, _Z | _N | _RMW },
+	{ "SMB7", _zp,            2, 5, _RMW },
 	{ "SED",  _implicit,      1, 2 },
 	{ "SBC",  _absolute_y,    3, 4, _N | _Z | _C | _V | _PB },
 	{ "PLX",  _implicit,      1, 4, _Z | _N },
 	{ "",     _invalid,       1, 1 },
 	{ "",     _invalid,       3, 4 },
 	{ "SBC",  _absolute_x,    3, 4, _N | _Z | _C | _V | _PB },
-	{ "INC",  _absolute_x,    3, 7, _Z | _N },
-	{ "BBS7", _zp_relative,   3, 4 },
+	{ "INC",  _absolute_x,    3, 7, _Z | _N | _RMW },
+	{ "BBS7", _zp_relative,   3, 5 },
 };
 
 static inline uint8_t _read_u8(struct cpu_65c02_t *s, uint16_t addr)
 {
+	const uint8_t *p = s->mem->rpage[addr >> 8];
+	
+	if(p)
+	{
+		return(p[addr & 0xFF]);
+	}
+	
 	return(s->mem->read(s->mem->private, addr));
 }
 
 static inline int8_t _read_i8(struct cpu_65c02_t *s, uint16_t addr)
 {
-	return((int8_t) s->mem->read(s->mem->private, addr));
+	return((int8_t) _read_u8(s, addr));
 }
 
 static inline uint16_t _read_u16(struct cpu_65c02_t *s, uint16_t addr)
 {
-	return(
-		s->mem->read(s->mem->private, addr) |
-	       (s->mem->read(s->mem->private, addr + 1) << 8)
-	);
+	return(_read_u8(s, addr) | (_read_u8(s, addr + 1) << 8));
 }
 
 static inline uint16_t _read_u16w(struct cpu_65c02_t *s, uint16_t addr)
 {
 	/* Wrap around inside page when reading MSB */
-	return(
-		s->mem->read(s->mem->private, addr) |
-	       (s->mem->read(s->mem->private, (addr & 0xFF00) + ((addr + 1) & 0xFF)) << 8)
-	);
+	return(_read_u8(s, addr) | (_read_u8(s, (addr & 0xFF00) + ((addr + 1) & 0xFF)) << 8));
 }
 
 static inline void _write_u8(struct cpu_65c02_t *s, uint16_t addr, uint8_t v)
 {
+	uint8_t *p = s->mem->wpage[addr >> 8];
+	
+	/* Anything written ends an idle loop */
+	s->writes++;
+	s->idle = 0;
+	
+	if(s->wlog && s->wlog->len < CPU_WRITE_LOG_MAX)
+	{
+		s->wlog->addr[s->wlog->len] = addr;
+		s->wlog->v[s->wlog->len++] = v;
+	}
+	
+	if(p)
+	{
+		p[addr & 0xFF] = v;
+		return;
+	}
+	
+	if(s->bus_timing)
+	{
+		s->bus_cycle = s->bus_write;
+	}
+	
 	s->mem->write(s->mem->private, addr, v);
 }
 
 static inline void _push_u8(struct cpu_65c02_t *s, uint8_t v)
 {
+	if(s->sp == 0x00) s->faults |= CPU_FAULT_STACK;
 	_write_u8(s, 0x0100 + s->sp--, v);
 }
 
@@ -397,6 +428,7 @@ static inline void _push_u16(struct cpu_65c02_t *s, uint16_t v)
 
 static inline uint8_t _pull_u8(struct cpu_65c02_t *s)
 {
+	if(s->sp == 0xFF) s->faults |= CPU_FAULT_STACK;
 	return(_read_u8(s, 0x0100 + ++s->sp));
 }
 
@@ -414,24 +446,61 @@ static inline uint8_t _cmp(struct cpu_65c02_t *s, uint8_t r, uint8_t m)
 	return(r - m);
 }
 
+/* Decimal mode ADC results, indexed by C, A and the operand. Bits 0-7
+ * are the result, bit 8 C and bit 9 V. N and Z follow from the result */
+static uint16_t _bcd[2][0x100][0x100];
+
+static void _bcd_init(void)
+{
+	static int done = 0;
+	uint16_t sum;
+	int a, m, c;
+	
+	if(done)
+	{
+		return;
+	}
+	
+	for(c = 0; c < 2; c++)
+	{
+		for(a = 0; a < 0x100; a++)
+		{
+			for(m = 0; m < 0x100; m++)
+			{
+				/* Adjust each nibble, invalid BCD included */
+				sum = (a & 0x0F) + (m & 0x0F) + c;
+				if(sum >= 0x0A) sum += 0x06;
+				
+				sum += (a & 0xF0) + (m & 0xF0);
+				if(sum >= 0xA0) sum += 0x60;
+				
+				_bcd[c][a][m] = (sum & 0xFF)
+				              | (sum > 0xFF ? 1 << 8 : 0)
+				              | (~(a ^ m) & (a ^ sum) & 0x80 ? 1 << 9 : 0);
+			}
+		}
+	}
+	
+	done = 1;
+}
+
 static inline uint8_t _adc(struct cpu_65c02_t *s, uint8_t m)
 {
 	uint16_t sum;
 	
 	if(s->d)
 	{
-		sum = (s->a & 0x0F) + (m & 0x0F) + s->c;
-		if(sum >= 0x0A) sum += 0x06;
+		sum = _bcd[s->c][s->a][m];
 		
-		sum += (s->a & 0xF0) + (m & 0xF0);
-		if(sum >= 0xA0) sum += 0x60;
-	}
-	else
-	{
-		sum = s->a + m + s->c;
+		s->c = (sum >> 8) & 1;
+		s->v = sum >> 9;
+		
+		return(sum & 0xFF);
 	}
 	
-	s->c = sum > 0xFF ? 1 : 0;
+	sum = s->a + m + s->c;
+	
+	s->c = sum >> 8;
 	s->v = (~(s->a ^ m) & (s->a ^ sum) & 0x80) ? 1 : 0;
 	
 	return(sum & 0xFF);
@@ -439,6 +508,7 @@ static inline uint8_t _adc(struct cpu_65c02_t *s, uint8_t m)
 
 static inline uint8_t _sbc(struct cpu_65c02_t *s, uint8_t m)
 {
+	/* The nines complement in decimal mode */
 	return(_adc(s, s->d ? 0x99 - m : ~m));
 }
 
@@ -446,32 +516,74 @@ static inline uint8_t _pack_status(struct cpu_65c02_t *s)
 {
 	uint8_t v;
 	
-	v = (s->n ? _N : 0)
-	  | (s->v ? _V : 0)
+	/* N and Z are materialised here from their lazy sources */
+	v = (s->nr & _N)
+	  | (s->v << 6)
 	  | (1 << 5)
 	  | 0
-	  | (s->d ? _D : 0)
-	  | (s->i ? _I : 0)
-	  | (s->z ? _Z : 0)
-	  | (s->c ? _C : 0);
+	  | (s->d << 3)
+	  | (s->i << 2)
+	  | (s->zr ? 0 : _Z)
+	  | (s->c << 0);
 	
 	return(v);
 }
 
 static inline void _unpack_status(struct cpu_65c02_t *s, uint8_t v)
 {
-	s->n = (v & _N ? 1 : 0);
+	s->nr = v & _N;
 	s->v = (v & _V ? 1 : 0);
 	s->d = (v & _D ? 1 : 0);
 	s->i = (v & _I ? 1 : 0);
-	s->z = (v & _Z ? 1 : 0);
+	s->zr = (v & _Z ? 0 : 1);
 	s->c = (v & _C ? 1 : 0);
 }
 
+static void _idle_check(struct cpu_65c02_t *s)
+{
+	uint8_t regs[5] = { s->a, s->x, s->y, s->sp, _pack_status(s) };
+	
+	/* The loop is idle if it arrives back at the same place in the
+	 * same state, having written nothing and read nothing that moves
+	 * on its own on the way round. Until something external changes
+	 * it will keep doing the same thing */
+	if(s->pc == s->idle_pc &&
+	   s->writes == s->idle_writes &&
+	   s->volatile_reads == s->idle_volatile_reads &&
+	   memcmp(regs, s->idle_regs, sizeof(regs)) == 0)
+	{
+		s->idle = s->cycle - s->idle_cycle;
+	}
+	else
+	{
+		s->idle = 0;
+	}
+	
+	s->idle_pc = s->pc;
+	s->idle_writes = s->writes;
+	s->idle_volatile_reads = s->volatile_reads;
+	s->idle_cycle = s->cycle;
+	memcpy(s->idle_regs, regs, sizeof(regs));
+}
+
+void cpu_memory_map(struct cpu_memory_t *mem, uint16_t addr, int len, uint8_t *r, uint8_t *w)
+{
+	int i;
+	
+	/* Map host memory directly into whole pages, NULL to unmap */
+	for(i = 0; i < len; i += 0x100)
+	{
+		mem->rpage[((addr + i) >> 8) & 0xFF] = r ? r + i : NULL;
+		mem->wpage[((addr + i) >> 8) & 0xFF] = w ? w + i : NULL;
+	}
+}
+
 void cpu_65c02_init(struct cpu_65c02_t *s, int clock_num, int clock_den, struct cpu_memory_t *mem)
 {
 	memset(s, 0, sizeof(struct cpu_65c02_t));
 	
+	_bcd_init();
+	
 	s->clock_num = clock_num;
 	s->clock_den = clock_den;
 	s->cycle = 0;
@@ -483,11 +595,11 @@ void cpu_65c02_init(struct cpu_65c02_t *s, int clock_num, int clock_den, struct
 
 void cpu_65c02_reset(struct cpu_65c02_t *s)
 {
-	s->n = 0;
+	s->nr = 0x00;
 	s->v = 0;
 	s->d = 0;
 	s->i = 1;
-	s->z = 1;
+	s->zr = 0x00;
 	s->c = 0;
 	
 	s->a = 0x00;
@@ -497,10 +609,48 @@ void cpu_65c02_reset(struct cpu_65c02_t *s)
 	s->pc = _read_u16(s, 0xFFFC);
 	
 	s->depth = 0;
+	s->wait = 0;
+	s->idle = 0;
+}
+
+uint8_t cpu_65c02_status(struct cpu_65c02_t *s)
+{
+	return(_pack_status(s));
+}
+
+void cpu_65c02_set_status(struct cpu_65c02_t *s, uint8_t v)
+{
+	_unpack_status(s, v);
+}
+
+/* An interrupt ends a WAI, even if it is masked */
+static void _wake(struct cpu_65c02_t *s)
+{
+	if(s->wait == 1)
+	{
+		s->wait = 0;
+		s->pc++;
+	}
 }
 
 void cpu_65c02_irq_custom(struct cpu_65c02_t *s, uint16_t addr, int brk)
 {
+	/* Only a reset starts a stopped CPU */
+	if(s->wait == 2)
+	{
+		return;
+	}
+	
+	_wake(s);
+	
+	if(s->bus_timing)
+	{
+		s->bus_cycle = s->bus_write = s->cycle;
+	}
+	
+	/* The handler isn't part of any idle loop */
+	s->idle = 0;
+	
 	_push_u16(s, s->pc);
 	_push_u8(s, _pack_status(s) | (brk ? _B : 0));
 	s->i = 1;
@@ -512,14 +662,128 @@ void cpu_65c02_irq_custom(struct cpu_65c02_t *s, uint16_t addr, int brk)
 void cpu_65c02_irq(struct cpu_65c02_t *s, int nmi)
 {
 	/* Don't interrupt in inhibit flag is set, unless NMI */
+	_wake(s);
 	if(!nmi && s->i) return;
 	cpu_65c02_irq_custom(s, _read_u16(s, nmi ? 0xFFFA : 0xFFFE), 0);
 }
 
+const char *cpu_65c02_mnemonic(uint8_t op)
+{
+	return(_instrs[op].m);
+}
+
+/* Format the instruction in b (3 bytes) at addr into out, which must
+ * hold at least 16 characters. Returns the instruction length */
+int cpu_65c02_disasm(char *out, uint16_t addr, const uint8_t *b)
+{
+	const struct _instr_t *ins = &_instrs[b[0]];
+	uint16_t w = b[1] | (b[2] << 8);
+	int n;
+	
+	if(ins->mode == _invalid)
+	{
+		sprintf(out, "???");
+		return(ins->l);
+	}
+	
+	n = sprintf(out, "%s", ins->m);
+	
+	switch(ins->mode)
+	{
+	case _invalid:       break;
+	case _implicit:      break;
+	case _a:             sprintf(out + n, " A"); break;
+	case _immediate:     sprintf(out + n, " #$%02X", b[1]); break;
+	case _absolute:      sprintf(out + n, " $%04X", w); break;
+	case _absolute_x:    sprintf(out + n, " $%04X,X", w); break;
+	case _absolute_y:    sprintf(out + n, " $%04X,Y", w); break;
+	case _relative:      sprintf(out + n, " $%04X", (uint16_t) (addr + 2 + (int8_t) b[1])); break;
+	case _zp:            sprintf(out + n, " $%02X", b[1]); break;
+	case _zp_x:          sprintf(out + n, " $%02X,X", b[1]); break;
+	case _zp_y:          sprintf(out + n, " $%02X,Y", b[1]); break;
+	case _indirect:      sprintf(out + n, " ($%04X)", w); break;
+	case _zp_indirect:   sprintf(out + n, " ($%02X)", b[1]); break;
+	case _zp_indirect_x: sprintf(out + n, " ($%02X,X)", b[1]); break;
+	case _indirect_x:    sprintf(out + n, " ($%04X,X)", w); break;
+	case _zp_indirect_y: sprintf(out + n, " ($%02X),Y", b[1]); break;
+	case _zp_relative:   sprintf(out + n, " $%02X,$%04X", b[1], (uint16_t) (addr + 3 + (int8_t) b[2])); break;
+	}
+	
+	return(ins->l);
+}
+
+/* The memory address the instruction in b refers to, or the branch
+ * target. Returns 0 if it has no address operand */
+int cpu_65c02_operand(uint16_t addr, const uint8_t *b, uint16_t *target)
+{
+	const struct _instr_t *ins = &_instrs[b[0]];
+	
+	switch(ins->mode)
+	{
+	case _absolute:
+	case _absolute_x:
+	case _absolute_y:
+	case _indirect:
+	case _indirect_x:
+		*target = b[1] | (b[2] << 8);
+		return(1);
+	
+	case _zp:
+	case _zp_x:
+	case _zp_y:
+	case _zp_indirect:
+	case _zp_indirect_x:
+	case _zp_indirect_y:
+		*target = b[1];
+		return(1);
+	
+	case _relative:
+		*target = addr + 2 + (int8_t) b[1];
+		return(1);
+	
+	case _zp_relative:
+		*target = addr + 3 + (int8_t) b[2];
+		return(1);
+	
+	default:
+		return(0);
+	}
+}
+
+void cpu_65c02_idle_skip(struct cpu_65c02_t *s, uint64_t cycle)
+{
+	uint64_t n;
+	
+	/* Only from the end of an iteration just found to be idle. The
+	 * CPU may have left the loop or been interrupted since */
+	if(!s->idle || cycle <= s->cycle ||
+	   s->pc != s->idle_pc ||
+	   s->cycle != s->idle_cycle ||
+	   s->writes != s->idle_writes ||
+	   s->volatile_reads != s->idle_volatile_reads)
+	{
+		return;
+	}
+	
+	/* Fast-forward whole iterations of the idle loop, stopping short of cycle */
+	n = (cycle - s->cycle) / s->idle * s->idle;
+	
+	s->cycle += n;
+	s->idle_cycle += n;
+	s->idle_skipped += n;
+	
+	if(s->prof)
+	{
+		profile_skip(s->prof, s->idle_pc, n);
+	}
+}
+
 void cpu_65c02_exec(struct cpu_65c02_t *s)
 {
-	uint8_t op = _read_u8(s, s->pc);
-	const struct _instr_t *ins = &_instrs[op];
+	uint16_t pc = s->pc;
+	uint8_t depth = s->depth;
+	uint8_t op;
+	const struct _instr_t *ins;
 	uint8_t r = 0;
 	uint8_t tc;
 	uint16_t m16 = 0x0000;
@@ -528,6 +792,15 @@ void cpu_65c02_exec(struct cpu_65c02_t *s)
 	uint16_t addr = 0x0000;
 	uint8_t ac = 0;
 	
+	if(s->bus_timing)
+	{
+		/* Timestamp the opcode and operand fetches at the start */
+		s->bus_cycle = s->cycle;
+	}
+	
+	op = _read_u8(s, s->pc);
+	ins = &_instrs[op];
+	
 	switch(ins->mode)
 	{
 	case _invalid:
@@ -643,11 +916,11 @@ void cpu_65c02_exec(struct cpu_65c02_t *s)
 		printf("[%lu PC:%04X A:%02X X:%02X Y:%02X SP:%02X %c%c--%c%c%c%c OP:%02X] %.*s%s",
 			s->cycle,
 			s->pc, s->a, s->x, s->y, s->sp,
-			s->n ? 'N' : '.',
+			s->nr & _N ? 'N' : '.',
 			s->v ? 'V' : '.',
 			s->d ? 'D' : '.',
 			s->i ? 'I' : '.',
-			s->z ? 'Z' : '.',
+			s->zr ? '.' : 'Z',
 			s->c ? 'C' : '.',
 			op,
 			s->depth,
@@ -678,6 +951,15 @@ void cpu_65c02_exec(struct cpu_65c02_t *s)
 		printf("          \n");
 	}
 	
+	if(s->bus_timing)
+	{
+		/* Data is read and written on the last cycle of the
+		 * instruction, or two cycles earlier for the read of a
+		 * read-modify-write */
+		s->bus_write = s->cycle + ins->mcycles + ac - 1;
+		s->bus_cycle = s->bus_write - (ins->flags & _RMW ? 2 : 0);
+	}
+	
 	switch(op)
 	{
 	case 0x00: s->pc += ins->l; cpu_65c02_irq_custom(s, _read_u16(s, 0xFFFE) - ins->l, 1); break; /* BRK */
@@ -693,7 +975,7 @@ void cpu_65c02_exec(struct cpu_65c02_t *s)
 	case 0x0D: r = s->a |= _read_u8(s, addr); break; /* ORA $addr */
 	case 0x0E: r = _read_u8(s, addr); s->c = r >> 7; r <<= 1; _write_u8(s, addr, r); break; /* ASL $addr */
 	case 0x0F: if((_read_u8(s, m8) & 0x01) == 0) s->pc += m8b; break; /* BBR0 $zp,$raddr */
-	case 0x10: if(!s->n) s->pc += (int8_t) m8; else ac = 0; break; /* BPL $raddr */
+	case 0x10: if(!(s->nr & _N)) s->pc += (int8_t) m8; else ac = 0; break; /* BPL $raddr */
 	case 0x11: r = s->a |= _read_u8(s, addr); break; /* ORA ($zp),y */
 	case 0x12: r = s->a |= _read_u8(s, addr); break; /* ORA ($zp) */
 	case 0x14: r = _read_u8(s, addr); _write_u8(s, addr, r & (0xFF ^ s->a)); r &= s->a; break; /* TRB $zp */
@@ -709,28 +991,28 @@ void cpu_65c02_exec(struct cpu_65c02_t *s)
 	case 0x1F: if((_read_u8(s, m8) & 0x02) == 0) s->pc += m8b; break; /* BBR1 $zp,$raddr */
 	case 0x20: _push_u16(s, s->pc + 2); s->pc = addr - ins->l; s->depth++; break; /* JSR $addr */
 	case 0x21: r = s->a &= _read_u8(s, addr); break; /* AND ($zp,x) */
-	case 0x24: r = _read_u8(s, addr); s->n = r >> 7; s->v = (r >> 6) & 1; r &= s->a; break; /* BIT $zp */
+	case 0x24: r = _read_u8(s, addr); s->nr = r; s->v = (r >> 6) & 1; r &= s->a; break; /* BIT $zp */
 	case 0x25: r = s->a &= _read_u8(s, addr); break; /* AND $zp */
 	case 0x26: r = _read_u8(s, addr); tc = s->c; s->c = r >> 7; r = (r << 1) | tc; _write_u8(s, addr, r); break; /* ROL $zp */
 	case 0x27: r = _read_u8(s, addr) & 0xFB; _write_u8(s, addr, r); break; /* RMB2 $zp */
 	case 0x28: _unpack_status(s, _pull_u8(s)); break; /* PLP */
 	case 0x29: r = s->a &= m8; break; /* AND # */
 	case 0x2A: tc = s->c; s->c = s->a >> 7; r = s->a = (s->a << 1) | tc; break; /* ROL A */
-	case 0x2C: r = _read_u8(s, addr); s->n = r >> 7; s->v = (r >> 6) & 1; r &= s->a; break; /* BIT $addr */
+	case 0x2C: r = _read_u8(s, addr); s->nr = r; s->v = (r >> 6) & 1; r &= s->a; break; /* BIT $addr */
 	case 0x2D: r = s->a &= _read_u8(s, addr); break; /* AND $addr */
 	case 0x2E: r = _read_u8(s, addr); tc = s->c; s->c = r >> 7; r = (r << 1) | tc; _write_u8(s, addr, r); break; /* ROL $addr */
 	case 0x2F: if((_read_u8(s, m8) & 0x04) == 0) s->pc += m8b; break; /* BBR2 $zp,$raddr */
-	case 0x30: if(s->n) s->pc += (int8_t) m8; else ac = 0; break; /* BMI $raddr */
+	case 0x30: if(s->nr & _N) s->pc += (int8_t) m8; else ac = 0; break; /* BMI $raddr */
 	case 0x31: r = s->a &= _read_u8(s, addr); break; /* AND ($zp),y */
 	case 0x32: r = s->a &= _read_u8(s, addr); break; /* AND ($zp) */
-	case 0x34: r = _read_u8(s, addr); s->n = r >> 7; s->v = (r >> 6) & 1; r &= s->a; break; /* BIT $zp,x */
+	case 0x34: r = _read_u8(s, addr); s->nr = r; s->v = (r >> 6) & 1; r &= s->a; break; /* BIT $zp,x */
 	case 0x35: r = s->a &= _read_u8(s, addr); break; /* AND $zp,x */
 	case 0x36: r = _read_u8(s, addr); tc = s->c; s->c = r >> 7; r = (r << 1) | tc; _write_u8(s, addr, r); break; /* ROL $zp,x */
 	case 0x37: r = _read_u8(s, addr) & 0xF7; _write_u8(s, addr, r); break; /* RMB3 $zp */
 	case 0x38: s->c = 1; break; /* SEC */
 	case 0x39: r = s->a &= _read_u8(s, addr); break; /* AND $addr,y */
 	case 0x3A: r = --s->a; break; /* DEC A */
-	case 0x3C: r = _read_u8(s, addr); s->n = r >> 7; s->v = (r >> 6) & 1; r &= s->a; break; /* BIT $addr,x */
+	case 0x3C: r = _read_u8(s, addr); s->nr = r; s->v = (r >> 6) & 1; r &= s->a; break; /* BIT $addr,x */
 	case 0x3D: r = s->a &= _read_u8(s, addr); break; /* AND $addr,x */
 	case 0x3E: r = _read_u8(s, addr); tc = s->c; s->c = r >> 7; r = (r << 1) | tc; _write_u8(s, addr, r); break; /* ROL $addr,x */
 	case 0x3F: if((_read_u8(s, m8) & 0x08) == 0) s->pc += m8b; break; /* BBR3 $zp,$raddr */
@@ -759,7 +1041,7 @@ void cpu_65c02_exec(struct cpu_65c02_t *s)
 	case 0x5E: r = _read_u8(s, addr); s->c = r & 1; r >>= 1; _write_u8(s, addr, r); break; /* LSR $addr,x */
 	case 0x5F: if((_read_u8(s, m8) & 0x20) == 0) s->pc += m8b; break; /* BBR5 $zp,$raddr */
 	case 0x60: s->pc = _pull_u16(s); s->depth--; break; /* RTS */
-	case 0x61: r = s->a = _adc(s, _read_u8(s, addr)); break; /* STA ($zp,x) */
+	case 0x61: r = s->a = _adc(s, _read_u8(s, addr)); break; /* ADC ($zp,x) */
 	case 0x64: _write_u8(s, addr, 0); break; /* STZ $zp */
 	case 0x65: r = s->a = _adc(s, _read_u8(s, addr)); break; /* ADC $zp */
 	case 0x66: r = _read_u8(s, addr); tc = s->c << 7; s->c = r & 1; r = (r >> 1) | tc; _write_u8(s, addr, r); break; /* ROR $zp */
@@ -853,7 +1135,7 @@ void cpu_65c02_exec(struct cpu_65c02_t *s)
 	case 0xCD: r = _cmp(s, s->a, _read_u8(s, addr)); break; /* CMP $addr */
 	case 0xCE: r = _read_u8(s, addr) - 1; _write_u8(s, addr, r); break; /* DEC $addr */
 	case 0xCF: if(_read_u8(s, m8) & 0x10) s->pc += m8b; break; /* BBS4 $zp,$raddr */
-	case 0xD0: if(!s->z) s->pc += (int8_t) m8; else ac = 0; break; /* BNE $raddr */
+	case 0xD0: if(s->zr) s->pc += (int8_t) m8; else ac = 0; break; /* BNE $raddr */
 	case 0xD1: r = _cmp(s, s->a, _read_u8(s, addr)); break; /* CMP ($zp),y */
 	case 0xD2: r = _cmp(s, s->a, _read_u8(s, addr)); break; /* CMP ($zp) */
 	case 0xD5: r = _cmp(s, s->a, _read_u8(s, addr)); break; /* CMP $zp,x */
@@ -878,7 +1160,7 @@ void cpu_65c02_exec(struct cpu_65c02_t *s)
 	case 0xED: r = s->a = _sbc(s, _read_u8(s, addr)); break; /* SBC $addr */
 	case 0xEE: r = _read_u8(s, addr) + 1; _write_u8(s, addr, r); break; /* INC $addr */
 	case 0xEF: if(_read_u8(s, m8) & 0x40) s->pc += m8b; break; /* BBS6 $zp,$raddr */
-	case 0xF0: if(s->z) s->pc += (int8_t) m8; else ac = 0; break; /* BEQ $raddr */
+	case 0xF0: if(!s->zr) s->pc += (int8_t) m8; else ac = 0; break; /* BEQ $raddr */
 	case 0xF1: r = s->a = _sbc(s, _read_u8(s, addr)); break; /* SBC ($zp),y */
 	case 0xF2: r = s->a = _sbc(s, _read_u8(s, addr)); break; /* SBC ($zp) */
 	case 0xF5: r = s->a = _sbc(s, _read_u8(s, addr)); break; /* SBC $zp,x */
@@ -890,16 +1172,71 @@ void cpu_65c02_exec(struct cpu_65c02_t *s)
 	case 0xFD: r = s->a = _sbc(s, _read_u8(s, addr)); break; /* SBC $addr,x */
 	case 0xFE: r = _read_u8(s, addr) + 1; _write_u8(s, addr, r); break; /* INC $addr,x */
 	case 0xFF: if(_read_u8(s, m8) & 0x80) s->pc += m8b; break; /* BBS7 $zp,$raddr */
-	default: printf("Unknown opcode:\n%04X: %02X\n", s->pc, op); break;
+	case 0xCB: if(s->wait) s->cycle -= 2; s->wait = 1; s->pc -= ins->l; break; /* WAI */
+	case 0xDB: if(s->wait) s->cycle -= 2; s->wait = 2; s->pc -= ins->l; break; /* STP */
+	
+	/* The W65C02S runs the reserved opcodes as NOPs of fixed length
+	 * and cycles, with no memory access beyond the operand */
+	case 0x02: case 0x22: case 0x42: case 0x62: case 0x82: case 0xC2: case 0xE2:
+	case 0x44: case 0x54: case 0xD4: case 0xF4: case 0x5C: case 0xDC: case 0xFC:
+	case 0x03: case 0x13: case 0x23: case 0x33: case 0x43: case 0x53: case 0x63: case 0x73:
+	case 0x83: case 0x93: case 0xA3: case 0xB3: case 0xC3: case 0xD3: case 0xE3: case 0xF3:
+	case 0x0B: case 0x1B: case 0x2B: case 0x3B: case 0x4B: case 0x5B: case 0x6B: case 0x7B:
+	case 0x8B: case 0x9B: case 0xAB: case 0xBB: case 0xEB: case 0xFB:
+		break;
+	
+	default: log_printf(LOG_CPU, LOG_ERROR, "Unknown opcode:\n%04X: %02X\n", s->pc, op); s->faults |= CPU_FAULT_OPCODE; break;
 	}
 	
 	if(ins->flags)
 	{
-		if(ins->flags & _Z) s->z = r ? 0 : 1; /* Zero flag */
-		if(ins->flags & _N) s->n = r >> 7;    /* Negative flag */
+		/* Only the source values are stored, the N and Z
+		 * flags are derived from them when they are needed */
+		if(ins->flags & _Z) s->zr = r; /* Zero flag */
+		if(ins->flags & _N) s->nr = r; /* Negative flag */
 	}
 	
 	s->pc += ins->l;
 	s->cycle += ins->mcycles + ac;
+	
+	if(s->prof)
+	{
+		profile_instr(s->prof, pc, op, depth, ins->mcycles + ac);
+	}
+	
+	/* Test for an idle loop on each short backwards jump */
+	if(s->pc <= pc && pc - s->pc < _IDLE_LOOP_MAX)
+	{
+		_idle_check(s);
+	}
+}
+
+static void _bus_setup(struct cpu_65c02_t *s)
+{
+	/* Drop the direct pages, every access goes through the handlers */
+	memset(s->mem->rpage, 0, sizeof(s->mem->rpage));
+	memset(s->mem->wpage, 0, sizeof(s->mem->wpage));
+}
+
+const struct cpu_65c02_engine_t cpu_65c02_engines[] = {
+	{ "fast",   "Interpreter with direct memory pages", NULL, &cpu_65c02_exec, 0 },
+	{ "bus",    "Interpreter with every access through the handlers", &_bus_setup, &cpu_65c02_exec, 0 },
+	{ "noidle", "Interpreter running every idle loop, compared at events", NULL, &cpu_65c02_exec, 1 },
+	{ NULL },
+};
+
+const struct cpu_65c02_engine_t *cpu_65c02_engine(const char *name)
+{
+	const struct cpu_65c02_engine_t *e;
+	
+	for(e = cpu_65c02_engines; e->name; e++)
+	{
+		if(strcmp(e->name, name) == 0)
+		{
+			return(e);
+		}
+	}
+	
+	return(NULL);
 }
 
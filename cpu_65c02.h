@@ -20,10 +20,31 @@
 
 #include <stdint.h>
 
+struct profile_t;
+
 struct cpu_memory_t {
 	uint8_t (*read) (void *private, uint16_t addr);
 	void (*write) (void *private, uint16_t addr, uint8_t v);
 	void *private;
+	
+	/* Optional direct pointers to host memory, one per 256 byte page.
+	 * Pages left NULL go through the read/write handlers above. */
+	uint8_t *rpage[0x100];
+	uint8_t *wpage[0x100];
+};
+
+/* Faults, noted in cpu_65c02_t.faults and left for the caller to act on */
+#define CPU_FAULT_OPCODE 1 /* An unknown opcode */
+#define CPU_FAULT_STACK  2 /* The stack pointer wrapped */
+#define CPU_FAULT_WRITE  4 /* A write to ROM or unmapped memory */
+
+/* A record of the writes made by one or more instructions */
+#define CPU_WRITE_LOG_MAX 16
+
+struct cpu_write_log_t {
+	int len;
+	uint16_t addr[CPU_WRITE_LOG_MAX];
+	uint8_t v[CPU_WRITE_LOG_MAX];
 };
 
 struct cpu_65c02_t {
@@ -39,29 +60,89 @@ struct cpu_65c02_t {
 	uint8_t  y;  /* Y Register      */
 	uint8_t  sp; /* Stack Pointer   */
 	
-	/* Status register, expanded */
-	uint8_t n;	/* Negative */
+	/* Status register, expanded. N and Z are lazy, only the last
+	 * value to affect them is kept. Use cpu_65c02_status() to read
+	 * the packed register */
+	uint8_t nr;	/* Negative, bit 7 of this value */
 	uint8_t v;	/* Overflow */
 	uint8_t d;	/* Decimal */
 	uint8_t i;	/* Interrupt */
-	uint8_t z;	/* Zero */
+	uint8_t zr;	/* Zero, set when this value is zero */
 	uint8_t c;	/* Carry */
 	
 	/* JSR depth, for pretty formatting */
 	uint8_t depth;
 	
+	/* 1 after WAI until an interrupt, 2 after STP until a reset. The
+	 * PC stays on the instruction, which repeats a cycle at a time */
+	uint8_t wait;
+	
+	/* Idle loop detection. idle is the length in cycles of a short
+	 * loop that has repeated with no writes, no volatile reads and no
+	 * change of state, or 0 if the CPU is doing something useful.
+	 * volatile_reads is counted by the memory handlers, for reads of
+	 * values that can change with time alone such as a running timer */
+	uint32_t writes;
+	uint32_t volatile_reads;
+	uint16_t idle_pc;
+	uint8_t idle_regs[5];
+	uint32_t idle_writes;
+	uint32_t idle_volatile_reads;
+	uint64_t idle_cycle;
+	uint32_t idle;
+	uint64_t idle_skipped;
+	
+	/* CPU_FAULT_* bits seen since last cleared */
+	uint8_t faults;
+	
 	/* Print lots of data to stdout */
 	int verbose;
 	
+	/* Optional execution profile */
+	struct profile_t *prof;
+	
+	/* Optional bus timing. While a memory handler runs, bus_cycle is
+	 * the cycle of the access rather than the start of the instruction */
+	int bus_timing;
+	uint64_t bus_cycle;
+	uint64_t bus_write;
+	
+	/* Optional log of memory writes, for lockstep checking */
+	struct cpu_write_log_t *wlog;
+	
 	/* Memory access */
 	struct cpu_memory_t *mem;
 };
 
+/* An interchangeable implementation of the core. setup() prepares a
+ * CPU and its memory to run on it, and may be NULL */
+struct cpu_65c02_engine_t {
+	const char *name;
+	const char *description;
+	void (*setup)(struct cpu_65c02_t *s);
+	void (*exec)(struct cpu_65c02_t *s);
+	
+	/* Never skips idle loops, so it can only be compared with a
+	 * core that does at the events that end them */
+	int no_idle;
+};
+
+extern const struct cpu_65c02_engine_t cpu_65c02_engines[];
+
+extern void cpu_memory_map(struct cpu_memory_t *mem, uint16_t addr, int len, uint8_t *r, uint8_t *w);
+
 extern void cpu_65c02_init(struct cpu_65c02_t *s, int clock_num, int clock_den, struct cpu_memory_t *mem);
 extern void cpu_65c02_reset(struct cpu_65c02_t *s);
+extern uint8_t cpu_65c02_status(struct cpu_65c02_t *s);
+extern void cpu_65c02_set_status(struct cpu_65c02_t *s, uint8_t v);
 extern void cpu_65c02_irq_custom(struct cpu_65c02_t *s, uint16_t addr, int brk);
 extern void cpu_65c02_irq(struct cpu_65c02_t *s, int type);
 extern void cpu_65c02_exec(struct cpu_65c02_t *s);
+extern const char *cpu_65c02_mnemonic(uint8_t op);
+extern int cpu_65c02_disasm(char *out, uint16_t addr, const uint8_t *b);
+extern int cpu_65c02_operand(uint16_t addr, const uint8_t *b, uint16_t *target);
+extern void cpu_65c02_idle_skip(struct cpu_65c02_t *s, uint64_t cycle);
+extern const struct cpu_65c02_engine_t *cpu_65c02_engine(const char *name);
 
 #endif
 
@@ -19,8 +19,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include "cpu_ccu3000.h"
+#include "hoststat.h"
+#include "log.h"
 
-#if 0
 static const char *_ccu_io_descriptions[0x100] = {
 	[0x00] = "Clock frequency",
 	[0x01] = "Control register",
@@ -103,19 +104,44 @@ static const char *_ccu_io_descriptions[0x100] = {
 	[0xFE] = "Reserved, do not use",
 	[0xFF] = "Reserved for testing purposes",
 };
-#endif
+
+/* Registers that only change when written or from outside the core
+ * between instructions, like the port inputs. Reads of anything else,
+ * such as the timer accumulators, stop a polling loop counting as idle */
+static const uint8_t _ccu_io_static[0x100] = {
+	[0x02] = 1, /* Reset cause */
+	[0x0C] = 1, /* Port 5 */
+	[0x0D] = 1, /* IR input */
+	[0x10] = 1, /* IM bus busy */
+	[0x40] = 1, /* Port 6 */
+	[0x42] = 1, /* Port 7 */
+	[0x44] = 1, /* Port 8 */
+	[0x46] = 1, /* IM bus busy */
+};
+
+static uint64_t _ccu_cycle(struct cpu_ccu3000_t *s)
+{
+	/* The cycle of the access in progress, if the core tracks it */
+	return(s->core.bus_timing ? s->core.bus_cycle : s->core.cycle);
+}
 
 static uint8_t _ccu_io_read(struct cpu_ccu3000_t *s, uint16_t addr)
 {
-	//const char *desc = _ccu_io_descriptions[addr & 0xFF];
+	const char *desc = _ccu_io_descriptions[addr & 0xFF];
 	uint8_t v = 0x00;
 	
-	//printf("ccuio:  Read $%03X: %s\n", addr, desc ? desc : "invalid");
+	s->io_reads[addr & 0xFF]++;
+	
+	if(!_ccu_io_static[addr & 0xFF])
+	{
+		s->core.volatile_reads++;
+	}
+	log_printf(LOG_IO, LOG_DEBUG, "ccuio:  Read $%03X: %s\n", addr, desc ? desc : "invalid");
 	
 	switch(addr)
 	{
 	case 0x202:
-		v = 1 << 0; /* '0': last RESET was generated by watchdog */
+		v = s->reset_cause == CCU3000_RESET_WATCHDOG ? 0 : 1 << 0; /* '0': last RESET was generated by watchdog */
 		break;
 	
 	case 0x20C:
@@ -125,6 +151,10 @@ static uint8_t _ccu_io_read(struct cpu_ccu3000_t *s, uint16_t addr)
 		//printf("Port 5 read: %02X\n", v);
 		break;
 	
+	case 0x20D:
+		v = s->ir_in;
+		break;
+	
 	case 0x210:
 		v = 0 << 0; /* '1' = IM bus (master) busy */
 		break;
@@ -153,6 +183,10 @@ static uint8_t _ccu_io_read(struct cpu_ccu3000_t *s, uint16_t addr)
 	case 0x246:
 		v = 0 << 0; /* '1' = IM bus (master) busy */
 		break;
+	
+	default:
+		s->io_unhandled[addr & 0xFF] |= 1;
+		break;
 	}
 	
 	return(v);
@@ -160,9 +194,9 @@ static uint8_t _ccu_io_read(struct cpu_ccu3000_t *s, uint16_t addr)
 
 static void _i2c_test(struct cpu_ccu3000_t *s)
 {
-	static uint8_t pv = 0x03;
-	static uint8_t sr = 0;
-	static uint8_t b = 0;
+	uint8_t pv = s->i2c_pv;
+	uint8_t sr = s->i2c_sr;
+	uint8_t b = s->i2c_b;
 	uint8_t v;
 	
 	/* Read the I2C bus status */
@@ -178,14 +212,15 @@ static void _i2c_test(struct cpu_ccu3000_t *s)
 	if(pv == 3 && v == 2)
 	{
 		/* Rising data edge while clock high */
-		printf("i2c: start\n");
+		log_printf(LOG_I2C, LOG_INFO, "i2c: start\n");
+		s->i2c_start = _ccu_cycle(s);
 		b = 0;
 		sr = 0;
 	}
 	else if(pv == 2 && v == 3)
 	{
 		/* Falling data edge while clock high */
-		printf("i2c: end\n");
+		log_printf(LOG_I2C, LOG_INFO, "i2c: end, %lu us\n", (_ccu_cycle(s) - s->i2c_start) * 1000000 * s->core.clock_den / s->core.clock_num);
 		b = 0;
 		sr = 0;
 	}
@@ -204,9 +239,9 @@ static void _i2c_test(struct cpu_ccu3000_t *s)
 			sr = (sr << 1) | (v & 1);
 		}
 		
-		if(b == 8)
+		if(b == 8 && !s->i2c_nack)
 		{
-			printf("i2c: byte 0x%02X\n", sr);
+			log_printf(LOG_I2C, LOG_INFO, "i2c: byte 0x%02X\n", sr);
 			
 			/* ACK */
 			//printf("i2c: asserting ACK\n");
@@ -226,23 +261,25 @@ static void _i2c_test(struct cpu_ccu3000_t *s)
 		b++;
 	}
 	
-	pv = v;
+	s->i2c_pv = v;
+	s->i2c_sr = sr;
+	s->i2c_b = b;
 }
 
 static void _timer_dump(struct cpu_ccu3000_t *s, int timer, int cbyte)
 {
-	printf("timer%d:\n", timer + 1);
+	log_printf(LOG_TIMER, LOG_INFO, "timer%d:\n", timer + 1);
 	
 	if(cbyte == 0)
 	{
 		const char *clocks[4] = { "pin", "fosc", "PHI2", "no clock" };
 		const char *start[4] = { "none (always active)", "edge", "pin", "\\pin" };
 		
-		printf("1:7: second serial input level: %s\n", s->timer[timer].ctrl[0] & 0x80 ? "enabled" : "disabled");
-		printf("1:5-6: clock select: %s\n", clocks[(s->timer[timer].ctrl[0] >> 5) & 3]);
-		printf("1:4: counter stop: %s\n", s->timer[timer].ctrl[0] & 0x10 ? "carry out accu" : "disabled");
-		printf("1:1-2: start condition: %s\n", start[(s->timer[timer].ctrl[0] >> 1) & 3]);
-		printf("1:0: active edge selection: %s\n", s->timer[timer].ctrl[0] & 1 ? "falling" : "rising");
+		log_printf(LOG_TIMER, LOG_INFO, "1:7: second serial input level: %s\n", s->timer[timer].ctrl[0] & 0x80 ? "enabled" : "disabled");
+		log_printf(LOG_TIMER, LOG_INFO, "1:5-6: clock select: %s\n", clocks[(s->timer[timer].ctrl[0] >> 5) & 3]);
+		log_printf(LOG_TIMER, LOG_INFO, "1:4: counter stop: %s\n", s->timer[timer].ctrl[0] & 0x10 ? "carry out accu" : "disabled");
+		log_printf(LOG_TIMER, LOG_INFO, "1:1-2: start condition: %s\n", start[(s->timer[timer].ctrl[0] >> 1) & 3]);
+		log_printf(LOG_TIMER, LOG_INFO, "1:0: active edge selection: %s\n", s->timer[timer].ctrl[0] & 1 ? "falling" : "rising");
 	}
 	else if(cbyte == 1)
 	{
@@ -250,38 +287,71 @@ static void _timer_dump(struct cpu_ccu3000_t *s, int timer, int cbyte)
 		const char *latch[8] = { "disabled", "carry accu C", "carry accu D", "pin", "\\pin", "prescaler output", "prescaler input", "undefined" };
 		const char *clock[4] = { "presc. input", "pre.output", "pin", "\\pin" };
 		
-		printf("2:6-7: pin output mode: %s\n", modes[(s->timer[timer].ctrl[1] >> 6) & 3]);
-		printf("2:3-5: read latch: %s\n", latch[(s->timer[timer].ctrl[1] >> 3) & 7]);
-		printf("2:1-2: accu clock: %s\n", clock[(s->timer[timer].ctrl[1] >> 1) & 3]);
-		printf("2:0: %s\n", s->timer[timer].ctrl[1] & 1 ? "use accu c with accu d as long one (16bit accu)" : "don't use accu c with accu d as long one (16bit accu)");
+		log_printf(LOG_TIMER, LOG_INFO, "2:6-7: pin output mode: %s\n", modes[(s->timer[timer].ctrl[1] >> 6) & 3]);
+		log_printf(LOG_TIMER, LOG_INFO, "2:3-5: read latch: %s\n", latch[(s->timer[timer].ctrl[1] >> 3) & 7]);
+		log_printf(LOG_TIMER, LOG_INFO, "2:1-2: accu clock: %s\n", clock[(s->timer[timer].ctrl[1] >> 1) & 3]);
+		log_printf(LOG_TIMER, LOG_INFO, "2:0: %s\n", s->timer[timer].ctrl[1] & 1 ? "use accu c with accu d as long one (16bit accu)" : "don't use accu c with accu d as long one (16bit accu)");
 	}
 	else if(cbyte == 2)
 	{
 		const char *event[8] = { "none", "pin", "\\pin", "carry accu C", "carry accu D", "undefined", "undefined", "undefined" };
 		const char *levent[4] = { "none", "carry accu C", "carry accu D", "reg. load" };
 		
-		printf("3:5-7: interrupt event: %s\n", event[(s->timer[timer].ctrl[2] >> 5) & 7]);
-		printf("3:3-4: load event: %s\n", levent[(s->timer[timer].ctrl[2] >> 3) & 3]);
-		printf("3:2: accu C input: %s\n", s->timer[timer].ctrl[2] & 0x04 ? "-1" : "bus register");
-		printf("3:1: accu D input: %s\n", s->timer[timer].ctrl[2] & 0x02 ? "-1" : "bus register");
-		printf("3:0: serial mode: %s\n", s->timer[timer].ctrl[2] & 0x01 ? "enabled" : "disabled");
+		log_printf(LOG_TIMER, LOG_INFO, "3:5-7: interrupt event: %s\n", event[(s->timer[timer].ctrl[2] >> 5) & 7]);
+		log_printf(LOG_TIMER, LOG_INFO, "3:3-4: load event: %s\n", levent[(s->timer[timer].ctrl[2] >> 3) & 3]);
+		log_printf(LOG_TIMER, LOG_INFO, "3:2: accu C input: %s\n", s->timer[timer].ctrl[2] & 0x04 ? "-1" : "bus register");
+		log_printf(LOG_TIMER, LOG_INFO, "3:1: accu D input: %s\n", s->timer[timer].ctrl[2] & 0x02 ? "-1" : "bus register");
+		log_printf(LOG_TIMER, LOG_INFO, "3:0: serial mode: %s\n", s->timer[timer].ctrl[2] & 0x01 ? "enabled" : "disabled");
 	}
 }
 
+static void _port_write(struct cpu_ccu3000_t *s, int port, uint8_t *reg, uint8_t v)
+{
+	if(*reg == v)
+	{
+		return;
+	}
+	
+	*reg = v;
+	
+	if(s->port_write)
+	{
+		s->port_write(s->port_private, s, port, _ccu_cycle(s));
+	}
+}
+
+static void _watchdog_kick(struct cpu_ccu3000_t *s)
+{
+	uint64_t cycle = _ccu_cycle(s);
+	
+	if(s->wd_armed && cycle - s->wd_kick > CCU3000_WATCHDOG_CYCLES * 3 / 4)
+	{
+		s->wd_near_misses++;
+	}
+	
+	s->wd_armed = 1;
+	s->wd_kick = cycle;
+}
+
 static void _ccu_io_write(struct cpu_ccu3000_t *s, uint16_t addr, uint8_t v)
 {
-	//const char *desc = _ccu_io_descriptions[addr & 0xFF];
+	const char *desc = _ccu_io_descriptions[addr & 0xFF];
 	
-	//printf("ccuio: Write $%03X = $%02X: %s\n", addr, v, desc ? desc : "invalid");
+	s->io_writes[addr & 0xFF]++;
+	log_printf(LOG_IO, LOG_DEBUG, "ccuio: Write $%03X = $%02X: %s\n", addr, v, desc ? desc : "invalid");
 	
 	switch(addr)
 	{
+	case 0x202:
+		_watchdog_kick(s);
+		break;
+	
 	case 0x20B:
-		s->p5_ddr = v;
+		_port_write(s, 5, &s->p5_ddr, v);
 		break;
 	
 	case 0x20C:
-		s->p5_data = v;
+		_port_write(s, 5, &s->p5_data, v);
 		
 		_i2c_test(s);
 		
@@ -385,27 +455,31 @@ static void _ccu_io_write(struct cpu_ccu3000_t *s, uint16_t addr, uint8_t v)
 		break;
 	
 	case 0x240:
-		s->p6_data = v;
+		_port_write(s, 6, &s->p6_data, v);
 		break;
 	
 	case 0x241:
-		s->p6_ddr = v;
+		_port_write(s, 6, &s->p6_ddr, v);
 		break;
 	
 	case 0x242:
-		s->p7_data = v;
+		_port_write(s, 7, &s->p7_data, v);
 		break;
 	
 	case 0x243:
-		s->p7_ddr = v;
+		_port_write(s, 7, &s->p7_ddr, v);
 		break;
 	
 	case 0x244:
-		s->p8_data = v;
+		_port_write(s, 8, &s->p8_data, v);
 		break;
 	
 	case 0x245:
-		s->p8_ddr = v;
+		_port_write(s, 8, &s->p8_ddr, v);
+		break;
+	
+	default:
+		s->io_unhandled[addr & 0xFF] |= 2;
 		break;
 	}
 }
@@ -416,6 +490,14 @@ static uint8_t _ccu_memory_read(void *private, uint16_t addr)
 	
 	if(addr >= 0x200 && addr < 0x300)
 	{
+		if(s->stats)
+		{
+			int64_t t = hoststat_now();
+			uint8_t v = _ccu_io_read(s, addr);
+			hoststat_io(s->stats, hoststat_now() - t);
+			return(v);
+		}
+		
 		return(_ccu_io_read(s, addr));
 	}
 	else if(addr < 0x0640)
@@ -437,7 +519,16 @@ static void _ccu_memory_write(void *private, uint16_t addr, uint8_t v)
 	
 	if(addr >= 0x200 && addr < 0x300)
 	{
-		_ccu_io_write(s, addr, v);
+		if(s->stats)
+		{
+			int64_t t = hoststat_now();
+			_ccu_io_write(s, addr, v);
+			hoststat_io(s->stats, hoststat_now() - t);
+		}
+		else
+		{
+			_ccu_io_write(s, addr, v);
+		}
 	}
 	else if(addr < 0x0640)
 	{
@@ -452,16 +543,29 @@ static void _ccu_memory_write(void *private, uint16_t addr, uint8_t v)
 
 static int _ccu_memory_init(struct cpu_memory_t *mem, struct cpu_ccu3000_t *s)
 {
-	s->ram = malloc(0x0640);
+	s->ram = calloc(0x0640, 1);
 	if(!s->ram)
 	{
 		return(-1);
 	}
 	
+	memset(mem, 0, sizeof(struct cpu_memory_t));
 	mem->private = s;
 	mem->read = &_ccu_memory_read;
 	mem->write = &_ccu_memory_write;
 	
+	/* Internal RAM can be accessed directly, except for the I/O
+	 * page at $200 and the page shared with external memory at $600 */
+	cpu_memory_map(mem, 0x0000, 0x0200, s->ram, s->ram);
+	cpu_memory_map(mem, 0x0300, 0x0300, s->ram + 0x0300, s->ram + 0x0300);
+	
+	/* Pass through any direct pages of the external memory */
+	if(s->ext)
+	{
+		memcpy(&mem->rpage[0x07], &s->ext->rpage[0x07], sizeof(uint8_t *) * 0xF9);
+		memcpy(&mem->wpage[0x07], &s->ext->wpage[0x07], sizeof(uint8_t *) * 0xF9);
+	}
+	
 	return(0);
 }
 
@@ -470,6 +574,7 @@ void cpu_ccu3000_init(struct cpu_ccu3000_t *s, int clock_num, int clock_den, str
 	memset(s, 0, sizeof(struct cpu_ccu3000_t));
 	
 	s->ext = mem;
+	s->i2c_pv = 0x03;
 	
 	_ccu_memory_init(&s->mem, s);
 	
@@ -480,6 +585,9 @@ void cpu_ccu3000_reset(struct cpu_ccu3000_t *s)
 {
 	cpu_65c02_reset(&s->core);
 	
+	s->irq_enabled = 0;
+	s->wd_armed = 0;
+	
 	s->p5_ddr = 0xFF;
 	s->p6_ddr = 0xFF;
 	s->p7_ddr = 0xFF;
@@ -496,6 +604,83 @@ void cpu_ccu3000_irq(struct cpu_ccu3000_t *s, int type)
 	cpu_65c02_irq(&s->core, type);
 }
 
+/* Resets the CPU if the watchdog has run out by cycle. Returns the
+ * cycle it should be checked again at */
+uint64_t cpu_ccu3000_watchdog(struct cpu_ccu3000_t *s, uint64_t cycle)
+{
+	if(!s->wd_armed)
+	{
+		return(cycle + CCU3000_WATCHDOG_CYCLES);
+	}
+	
+	if(cycle < s->wd_kick + CCU3000_WATCHDOG_CYCLES)
+	{
+		return(s->wd_kick + CCU3000_WATCHDOG_CYCLES);
+	}
+	
+	log_printf(LOG_CPU, LOG_ERROR, "ccu: watchdog reset at cycle %lu, PC $%04X\n", cycle, s->core.pc);
+	
+	s->wd_resets++;
+	cpu_ccu3000_reset(s);
+	s->reset_cause = CCU3000_RESET_WATCHDOG;
+	
+	return(cycle + CCU3000_WATCHDOG_CYCLES);
+}
+
+/* Set the levels driven onto an input port from outside */
+void cpu_ccu3000_port_input(struct cpu_ccu3000_t *s, int port, uint8_t v)
+{
+	switch(port)
+	{
+	case 5: s->p5_data_in = v; break;
+	case 6: s->p6_data_in = v; break;
+	case 7: s->p7_data_in = v; break;
+	case 8: s->p8_data_in = v; break;
+	}
+}
+
+void cpu_ccu3000_dump(struct cpu_ccu3000_t *s)
+{
+	int i;
+	
+	printf("ccu: interrupts %s\n", s->irq_enabled ? "enabled" : "disabled");
+	
+	for(i = 0; i < 3; i++)
+	{
+		printf("ccu: timer%d: ctrl %02X %02X %02X, prescaler %04X, accu %04X, adder %04X\n",
+			i + 1,
+			s->timer[i].ctrl[0], s->timer[i].ctrl[1], s->timer[i].ctrl[2],
+			s->timer[i].prescaler, s->timer[i].accu, s->timer[i].adder);
+	}
+	
+	printf("ccu: port5: ddr %02X, out %02X, in %02X\n", s->p5_ddr, s->p5_data, s->p5_data_in);
+	printf("ccu: port6: ddr %02X, out %02X, in %02X\n", s->p6_ddr, s->p6_data, s->p6_data_in);
+	printf("ccu: port7: ddr %02X, out %02X, in %02X\n", s->p7_ddr, s->p7_data, s->p7_data_in);
+	printf("ccu: port8: ddr %02X, out %02X, in %02X\n", s->p8_ddr, s->p8_data, s->p8_data_in);
+	printf("ccu: watchdog: %s, last reset by %s, %lu resets, %lu near misses\n",
+		s->wd_armed ? "armed" : "off",
+		s->reset_cause == CCU3000_RESET_WATCHDOG ? "watchdog" : "power on",
+		s->wd_resets, s->wd_near_misses);
+}
+
+/* The accesses to each I/O register so far, marking those the
+ * emulation ignores with '*' */
+void cpu_ccu3000_io_dump(struct cpu_ccu3000_t *s)
+{
+	int i;
+	
+	for(i = 0; i < 0x100; i++)
+	{
+		if(s->io_reads[i] || s->io_writes[i])
+		{
+			printf("ccu: io: $%03X %10lu reads%c %10lu writes%c  %s\n", 0x200 + i,
+				s->io_reads[i], s->io_unhandled[i] & 1 ? '*' : ' ',
+				s->io_writes[i], s->io_unhandled[i] & 2 ? '*' : ' ',
+				_ccu_io_descriptions[i] ? _ccu_io_descriptions[i] : "");
+		}
+	}
+}
+
 void cpu_ccu3000_exec(struct cpu_ccu3000_t *s)
 {
 	cpu_65c02_exec(&s->core);
@@ -20,6 +20,22 @@
 
 #include "cpu_65c02.h"
 
+struct hoststat_t;
+struct cpu_ccu3000_t;
+
+/* Cause of the last reset, as read back from $202 */
+#define CCU3000_RESET_POWER    0
+#define CCU3000_RESET_WATCHDOG 1
+
+/* Watchdog timeout in cycles after the last write to $202. The real
+ * value isn't known; the firmware only writes it before giving up and
+ * showing an error, and this leaves the error on screen for a while */
+#define CCU3000_WATCHDOG_CYCLES (1 << 20)
+
+/* Called when a data or direction register of ports 5-8 changes, with
+ * the port number and the cycle of the write */
+typedef void (*cpu_ccu3000_port_t)(void *private, struct cpu_ccu3000_t *s, int port, uint64_t cycle);
+
 struct cpu_ccu3000_timer_t {
 	uint8_t ctrl[3];
 	uint16_t prescaler;
@@ -53,6 +69,40 @@ struct cpu_ccu3000_t {
 	uint8_t p8_ddr;
 	uint8_t p8_data;
 	uint8_t p8_data_in;
+	
+	/* Level on the IR input, read from $20D */
+	uint8_t ir_in;
+	
+	/* I2C bus monitor on port 5: last SCL/SDA levels, shift register,
+	 * bit count and the cycle of the start condition. Each byte is
+	 * acknowledged unless i2c_nack is set */
+	uint8_t i2c_pv;
+	uint8_t i2c_sr;
+	uint8_t i2c_b;
+	uint64_t i2c_start;
+	int i2c_nack;
+	
+	/* Watchdog, armed by the first write to $202 and restarted by every
+	 * write after that. Writes in the last quarter of the timeout are
+	 * counted as near misses */
+	int reset_cause;
+	int wd_armed;
+	uint64_t wd_kick;
+	uint64_t wd_near_misses;
+	uint64_t wd_resets;
+	
+	/* Accesses to each I/O register at $200-$2FF. io_unhandled has bit 0
+	 * set if a read was ignored, bit 1 for a write */
+	uint64_t io_reads[0x100];
+	uint64_t io_writes[0x100];
+	uint8_t io_unhandled[0x100];
+	
+	/* Optional host time accounting for the I/O handlers */
+	struct hoststat_t *stats;
+	
+	/* Optional port observer */
+	cpu_ccu3000_port_t port_write;
+	void *port_private;
 };
 
 extern void cpu_ccu3000_init(struct cpu_ccu3000_t *s, int clock_num, int clock_den, struct cpu_memory_t *mem);
@@ -60,6 +110,10 @@ extern void cpu_ccu3000_reset(struct cpu_ccu3000_t *s);
 extern void cpu_ccu3000_irq_custom(struct cpu_ccu3000_t *s, uint16_t addr, int brk);
 extern void cpu_ccu3000_irq(struct cpu_ccu3000_t *s, int type);
 extern void cpu_ccu3000_exec(struct cpu_ccu3000_t *s);
+extern uint64_t cpu_ccu3000_watchdog(struct cpu_ccu3000_t *s, uint64_t cycle);
+extern void cpu_ccu3000_port_input(struct cpu_ccu3000_t *s, int port, uint8_t v);
+extern void cpu_ccu3000_dump(struct cpu_ccu3000_t *s);
+extern void cpu_ccu3000_io_dump(struct cpu_ccu3000_t *s);
 
 #endif
 
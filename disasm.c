@@ -0,0 +1,107 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpu_65c02.h"
+#include "disasm.h"
+#include "rommap.h"
+
+int disasm_init(struct disasm_t *s, const uint8_t *rom, const uint8_t *map, uint16_t base, uint32_t size)
+{
+	uint8_t b[3];
+	uint32_t i;
+	
+	memset(s, 0, sizeof(struct disasm_t));
+	s->rom = rom;
+	s->map = map;
+	s->base = base;
+	s->size = size;
+	
+	s->len = malloc(size);
+	s->start = calloc(size, 1);
+	s->text = malloc(size * DISASM_TEXT);
+	
+	if(!s->len || !s->start || !s->text)
+	{
+		disasm_free(s);
+		return(-1);
+	}
+	
+	for(i = 0; i < size; i++)
+	{
+		b[0] = rom[i];
+		b[1] = i + 1 < size ? rom[i + 1] : 0xFF;
+		b[2] = i + 2 < size ? rom[i + 2] : 0xFF;
+		
+		s->len[i] = cpu_65c02_disasm(s->text[i], base + i, b);
+		
+		if(map && !(map[i] & ROMMAP_CODE))
+		{
+			sprintf(s->text[i], ".byte $%02X", b[0]);
+			s->len[i] = 1;
+		}
+	}
+	
+	if(map)
+	{
+		for(i = 0; i < size; i++)
+		{
+			s->start[i] = (map[i] & ROMMAP_OP) || !(map[i] & ROMMAP_CODE);
+		}
+	}
+	else
+	{
+		for(i = 0; i < size; i += s->len[i])
+		{
+			s->start[i] = 1;
+		}
+	}
+	
+	return(0);
+}
+
+void disasm_free(struct disasm_t *s)
+{
+	free(s->len);
+	free(s->start);
+	free(s->text);
+	memset(s, 0, sizeof(struct disasm_t));
+}
+
+int disasm_contains(struct disasm_t *s, uint16_t addr)
+{
+	return(s->text && addr >= s->base && (uint32_t) (addr - s->base) < s->size);
+}
+
+uint16_t disasm_align(struct disasm_t *s, uint16_t addr)
+{
+	uint32_t i;
+	
+	if(!disasm_contains(s, addr))
+	{
+		return(addr);
+	}
+	
+	/* Back up to the start of the instruction this address is the
+	 * middle of, if any */
+	for(i = addr - s->base; i > 0 && !s->start[i]; i--);
+	
+	return(i + s->len[i] > (uint32_t) (addr - s->base) ? s->base + i : addr);
+}
+
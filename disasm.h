@@ -0,0 +1,47 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef _DISASM_H
+#define _DISASM_H
+
+#include <stdint.h>
+
+#define DISASM_TEXT 16
+
+/* A ROM decoded once. Every address has its instruction pre-rendered,
+ * and start marks the instruction boundaries so listings from any
+ * address line up. The boundaries come from a romscan code map if
+ * there is one, where bytes never reached as code are shown as data,
+ * otherwise from a linear sweep from the base */
+struct disasm_t {
+	const uint8_t *rom;
+	const uint8_t *map;
+	uint16_t base;
+	uint32_t size;
+	
+	uint8_t *len;
+	uint8_t *start;
+	char (*text)[DISASM_TEXT];
+};
+
+extern int disasm_init(struct disasm_t *s, const uint8_t *rom, const uint8_t *map, uint16_t base, uint32_t size);
+extern void disasm_free(struct disasm_t *s);
+extern int disasm_contains(struct disasm_t *s, uint16_t addr);
+extern uint16_t disasm_align(struct disasm_t *s, uint16_t addr);
+
+#endif
+
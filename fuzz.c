@@ -0,0 +1,445 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Fork server for fuzzing the firmware. Both machines are booted once to
+ * a chosen point, then each test case runs in a fork() of that state. A
+ * test case is a list of 3 byte records, each an input and how long to
+ * run after it:
+ * 
+ *   0: <what> % 3 selects the input
+ *        0 = front panel buttons, port 6 (pressed = 0)
+ *        1 = IR input, $20D
+ *        2 = I2C, bit 0 of the value set refuses to ACK each byte
+ *   1: the value
+ *   2: run for (n + 1) ms before the next record
+ * 
+ * An unknown opcode, a stack wrap or a write to ROM is a crash. Under
+ * afl-fuzz (__AFL_SHM_ID set) edge coverage goes to its shared map and
+ * the AFL fork server protocol is spoken on fds 198/199, otherwise each
+ * input file named on the command line is run and its new coverage of
+ * the per-PC bitmap reported */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/shm.h>
+#include <sys/wait.h>
+#include "cpu_65c02.h"
+#include "cpu_ccu3000.h"
+#include "machine.h"
+#include "log.h"
+
+#define SLICE_CYCLES 4000     /* 1ms */
+#define BOOT_MAX     40000000 /* 10s to reach the starting point */
+#define INPUT_MAX    4096
+#define AFL_MAP_SIZE 0x10000
+#define AFL_FD       198
+
+/* What a test case leaves behind, in memory shared with the parent */
+struct _result_t {
+	
+	/* Per-PC coverage, one byte per address for each CPU */
+	uint8_t cov[2][0x10000];
+	
+	/* CPU_FAULT_* bits, and the CPU and PC of the first fault */
+	int faults;
+	int fault_cpu;
+	uint16_t fault_pc;
+};
+
+struct _fuzz_t {
+	struct machine_t m;
+	
+	/* Stop when this CPU (0 = SRB1, 1 = ACM) reaches pc, if pc >= 0 */
+	int stop_cpu;
+	int stop_pc;
+	
+	/* Faults while booting are not crashes, nor are those ignored */
+	int boot;
+	int ignore;
+	
+	/* The result, and the AFL edge map if running under afl-fuzz */
+	struct _result_t *r;
+	uint8_t *afl;
+	uint16_t prev[2];
+};
+
+static const char *_cpu_names[2] = { "srb1", "acm" };
+
+static int _step(struct _fuzz_t *f, int cpu, struct cpu_65c02_t *core, uint64_t next)
+{
+	uint16_t pc = core->pc;
+	
+	if(cpu == f->stop_cpu && pc == f->stop_pc)
+	{
+		return(1);
+	}
+	
+	if(f->afl)
+	{
+		f->afl[(pc ^ f->prev[cpu] ^ (cpu << 15)) & (AFL_MAP_SIZE - 1)]++;
+		f->prev[cpu] = pc >> 1;
+	}
+	else
+	{
+		f->r->cov[cpu][pc] = 1;
+	}
+	
+	cpu_65c02_exec(core);
+	
+	if((core->faults & ~f->ignore) && !f->boot)
+	{
+		f->r->faults = core->faults & ~f->ignore;
+		f->r->fault_cpu = cpu;
+		f->r->fault_pc = pc;
+		return(1);
+	}
+	
+	if(core->idle)
+	{
+		cpu_65c02_idle_skip(core, next);
+	}
+	
+	return(0);
+}
+
+/* Run both machines until the SRB1 reaches cycle, a stop or a fault */
+static int _run(struct _fuzz_t *f, uint64_t cycle)
+{
+	struct machine_t *m = &f->m;
+	uint64_t next;
+	
+	while(m->srb1.ccu.core.cycle < cycle)
+	{
+		next = m->srb1.ccu.core.cycle + SLICE_CYCLES;
+		if(m->sched.next < next) next = m->sched.next;
+		if(cycle < next) next = cycle;
+		
+		while(m->srb1.ccu.core.cycle < next)
+		{
+			if(_step(f, 0, &m->srb1.ccu.core, next))
+			{
+				return(1);
+			}
+		}
+		
+		next = m->srb1.ccu.core.cycle * m->acm.cpu.clock_num / m->srb1.ccu.core.clock_num;
+		
+		while(m->acm.cpu.cycle < next)
+		{
+			if(_step(f, 1, &m->acm.cpu, next))
+			{
+				return(1);
+			}
+		}
+		
+		sched_run(&m->sched, m->srb1.ccu.core.cycle);
+	}
+	
+	return(0);
+}
+
+/* Run one test case, returning the CPU_FAULT_* bits it caused */
+static int _test(struct _fuzz_t *f, const char *path)
+{
+	struct cpu_ccu3000_t *ccu = &f->m.srb1.ccu;
+	uint8_t in[INPUT_MAX];
+	size_t len, i;
+	FILE *fp;
+	
+	fp = fopen(path, "rb");
+	if(!fp)
+	{
+		perror(path);
+		return(0);
+	}
+	
+	len = fread(in, 1, sizeof(in), fp);
+	fclose(fp);
+	
+	for(i = 0; i + 3 <= len; i += 3)
+	{
+		switch(in[i] % 3)
+		{
+		case 0: cpu_ccu3000_port_input(ccu, 6, in[i + 1]); break;
+		case 1: ccu->ir_in = in[i + 1]; break;
+		case 2: ccu->i2c_nack = in[i + 1] & 1; break;
+		}
+		
+		if(_run(f, ccu->core.cycle + (in[i + 2] + 1) * SLICE_CYCLES))
+		{
+			break;
+		}
+	}
+	
+	return(f->r->faults);
+}
+
+/* Serve test cases to afl-fuzz until it closes the pipe */
+static int _afl_server(struct _fuzz_t *f, const char *path)
+{
+	uint32_t v;
+	int status;
+	pid_t pid;
+	
+	/* Tell it we're here. If nobody is listening run the case once */
+	v = 0;
+	if(write(AFL_FD + 1, &v, 4) != 4)
+	{
+		if(_test(f, path))
+		{
+			abort();
+		}
+		
+		return(0);
+	}
+	
+	while(read(AFL_FD, &v, 4) == 4)
+	{
+		pid = fork();
+		if(pid < 0)
+		{
+			return(-1);
+		}
+		
+		if(pid == 0)
+		{
+			close(AFL_FD);
+			close(AFL_FD + 1);
+			
+			if(_test(f, path))
+			{
+				abort();
+			}
+			
+			_exit(0);
+		}
+		
+		v = pid;
+		if(write(AFL_FD + 1, &v, 4) != 4 || waitpid(pid, &status, 0) < 0)
+		{
+			return(-1);
+		}
+		
+		v = status;
+		if(write(AFL_FD + 1, &v, 4) != 4)
+		{
+			return(-1);
+		}
+	}
+	
+	return(0);
+}
+
+static void _usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options] <input> ...\n"
+		"\n"
+		"  -b <cpu>:<addr>  Start each case when the srb1 or acm CPU reaches\n"
+		"                   addr (hex) (default: the end of the boot)\n"
+		"  -x <fault>       Don't treat opcode, stack or write faults as crashes\n"
+		"  -o <prefix>      Write the total coverage to <prefix>.srb1.cov and\n"
+		"                   <prefix>.acm.cov, one byte per address\n"
+		"  -v               Keep the emulator messages on stdout\n",
+		name
+	);
+}
+
+int main(int argc, char *argv[])
+{
+	static struct _fuzz_t f;
+	static uint8_t total[2][0x10000];
+	const char *output = NULL;
+	const char *afl;
+	char path[1024];
+	int verbose = 0;
+	int crashes = 0;
+	int status, n, c, i, j;
+	char *e;
+	pid_t pid;
+	FILE *fp;
+	
+	f.stop_cpu = 0;
+	f.stop_pc = -1;
+	
+	while((c = getopt(argc, argv, "b:x:o:v")) != -1)
+	{
+		switch(c)
+		{
+		case 'b':
+			e = strchr(optarg, ':');
+			if(!e || (strncmp(optarg, "srb1:", 5) != 0 && strncmp(optarg, "acm:", 4) != 0))
+			{
+				_usage(argv[0]);
+				return(-1);
+			}
+			f.stop_cpu = optarg[0] == 'a';
+			f.stop_pc = strtol(e + 1, NULL, 16) & 0xFFFF;
+			break;
+		case 'x':
+			if(strcmp(optarg, "opcode") == 0) f.ignore |= CPU_FAULT_OPCODE;
+			else if(strcmp(optarg, "stack") == 0) f.ignore |= CPU_FAULT_STACK;
+			else if(strcmp(optarg, "write") == 0) f.ignore |= CPU_FAULT_WRITE;
+			else
+			{
+				_usage(argv[0]);
+				return(-1);
+			}
+			break;
+		case 'o': output = optarg; break;
+		case 'v': verbose = 1; break;
+		default: _usage(argv[0]); return(-1);
+		}
+	}
+	
+	if(optind == argc)
+	{
+		_usage(argv[0]);
+		return(-1);
+	}
+	
+	/* The peripherals report on stdout, the results go to stderr */
+	if(!verbose)
+	{
+		log_levels("all=off");
+	}
+	
+	if(machine_init(&f.m, NULL) != 0)
+	{
+		fprintf(stderr, "Failed to initialise the machine\n");
+		return(-1);
+	}
+	
+	f.r = mmap(NULL, sizeof(struct _result_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(f.r == MAP_FAILED)
+	{
+		perror("mmap");
+		return(-1);
+	}
+	
+	/* Boot to the starting point */
+	f.boot = 1;
+	
+	if(f.stop_pc < 0)
+	{
+		_run(&f, MACHINE_BOOT_CYCLES);
+	}
+	else if(_run(&f, BOOT_MAX) == 0)
+	{
+		fprintf(stderr, "%s $%04X was not reached\n", _cpu_names[f.stop_cpu], f.stop_pc);
+		return(-1);
+	}
+	
+	f.boot = 0;
+	f.stop_pc = -1;
+	f.m.srb1.ccu.core.faults = 0;
+	f.m.acm.cpu.faults = 0;
+	
+	afl = getenv("__AFL_SHM_ID");
+	if(afl)
+	{
+		f.afl = shmat(atoi(afl), NULL, 0);
+		if(f.afl == (void *) -1)
+		{
+			perror("shmat");
+			return(-1);
+		}
+		
+		return(_afl_server(&f, argv[optind]));
+	}
+	
+	/* The boot counts towards the total, so only new code is reported */
+	memcpy(total, f.r->cov, sizeof(total));
+	
+	for(i = optind; i < argc; i++)
+	{
+		memset(f.r, 0, sizeof(struct _result_t));
+		fflush(stdout);
+		
+		pid = fork();
+		if(pid < 0)
+		{
+			perror("fork");
+			return(-1);
+		}
+		
+		if(pid == 0)
+		{
+			_exit(_test(&f, argv[i]));
+		}
+		
+		waitpid(pid, &status, 0);
+		
+		for(n = j = 0; j < 2 << 16; j++)
+		{
+			if(f.r->cov[j >> 16][j & 0xFFFF] && !total[j >> 16][j & 0xFFFF])
+			{
+				total[j >> 16][j & 0xFFFF] = 1;
+				n++;
+			}
+		}
+		
+		if(WIFSIGNALED(status))
+		{
+			fprintf(stderr, "%s: killed by signal %d\n", argv[i], WTERMSIG(status));
+			crashes++;
+		}
+		else if(f.r->faults)
+		{
+			fprintf(stderr, "%s: crash: %s%s%sat %s $%04X, %d new\n", argv[i],
+				f.r->faults & CPU_FAULT_OPCODE ? "unknown opcode " : "",
+				f.r->faults & CPU_FAULT_STACK ? "stack wrap " : "",
+				f.r->faults & CPU_FAULT_WRITE ? "bad write " : "",
+				_cpu_names[f.r->fault_cpu], f.r->fault_pc, n);
+			crashes++;
+		}
+		else
+		{
+			fprintf(stderr, "%s: %d new\n", argv[i], n);
+		}
+	}
+	
+	for(n = j = 0; j < 2 << 16; j++)
+	{
+		n += total[j >> 16][j & 0xFFFF];
+	}
+	
+	fprintf(stderr, "%d cases, %d crashes, %d addresses covered\n", argc - optind, crashes, n);
+	
+	for(i = 0; output && i < 2; i++)
+	{
+		snprintf(path, sizeof(path), "%s.%s.cov", output, _cpu_names[i]);
+		
+		fp = fopen(path, "wb");
+		if(!fp)
+		{
+			perror(path);
+			return(-1);
+		}
+		
+		fwrite(total[i], 1, 0x10000, fp);
+		fclose(fp);
+	}
+	
+	return(crashes ? 1 : 0);
+}
+
@@ -0,0 +1,660 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "gdbstub.h"
+
+static const char *_names[2] = { "SRB1 CCU3000", "ACM 65C02" };
+
+static const char _target_xml[] =
+	"<?xml version=\"1.0\"?>"
+	"<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+	"<target><feature name=\"org.sanslogic.65c02\">"
+	"<reg name=\"a\" bitsize=\"8\" type=\"uint8\"/>"
+	"<reg name=\"x\" bitsize=\"8\" type=\"uint8\"/>"
+	"<reg name=\"y\" bitsize=\"8\" type=\"uint8\"/>"
+	"<reg name=\"p\" bitsize=\"8\" type=\"uint8\"/>"
+	"<reg name=\"sp\" bitsize=\"8\" type=\"uint8\"/>"
+	"<reg name=\"pc\" bitsize=\"16\" type=\"code_ptr\"/>"
+	"</feature></target>";
+
+static int _hex(char c)
+{
+	if(c >= '0' && c <= '9') return(c - '0');
+	if(c >= 'a' && c <= 'f') return(c - 'a' + 10);
+	if(c >= 'A' && c <= 'F') return(c - 'A' + 10);
+	return(-1);
+}
+
+static int _byte(const char *p)
+{
+	int h = _hex(p[0]);
+	int l = h < 0 ? -1 : _hex(p[1]);
+	
+	return(l < 0 ? -1 : (h << 4) | l);
+}
+
+static void _close(struct gdbstub_t *s)
+{
+	close(s->fd);
+	s->fd = -1;
+	s->len = 0;
+	
+	/* Leave the emulator running without a debugger */
+	s->running = 0;
+	*s->paused = 0;
+	
+	printf("gdbstub: client disconnected\n");
+}
+
+static void _send_raw(struct gdbstub_t *s, const char *data, int len)
+{
+	int r;
+	
+	while(len > 0 && s->fd >= 0)
+	{
+		r = send(s->fd, data, len, MSG_NOSIGNAL);
+		
+		if(r < 0 && (errno == EINTR || errno == EAGAIN))
+		{
+			continue;
+		}
+		else if(r <= 0)
+		{
+			_close(s);
+			return;
+		}
+		
+		data += r;
+		len -= r;
+	}
+}
+
+static void _send(struct gdbstub_t *s, const char *data)
+{
+	char tail[4];
+	uint8_t sum = 0;
+	const char *p;
+	
+	for(p = data; *p; p++)
+	{
+		sum += *p;
+	}
+	
+	sprintf(tail, "#%02x", sum);
+	
+	_send_raw(s, "$", 1);
+	_send_raw(s, data, strlen(data));
+	_send_raw(s, tail, 3);
+}
+
+static void _stop_reply(struct gdbstub_t *s)
+{
+	char r[64];
+	int t;
+	
+	for(t = 0; t < 2 && !s->watch[t]->hit; t++);
+	
+	if(t == 2)
+	{
+		/* Paused by hand or interrupted */
+		sprintf(r, "T02thread:%02x;", s->g + 1);
+	}
+	else if(s->watch[t]->hit == WATCH_READ)
+	{
+		sprintf(r, "T05thread:%02x;rwatch:%04x;", t + 1, s->watch[t]->hit_addr);
+	}
+	else if(s->watch[t]->hit == WATCH_WRITE)
+	{
+		sprintf(r, "T05thread:%02x;watch:%04x;", t + 1, s->watch[t]->hit_addr);
+	}
+	else
+	{
+		sprintf(r, "T05thread:%02x;", t + 1);
+	}
+	
+	if(t < 2)
+	{
+		s->g = s->c = t;
+	}
+	
+	s->running = 0;
+	_send(s, r);
+}
+
+static void _step(struct gdbstub_t *s)
+{
+	struct cpu_65c02_t *cpu = s->cpu[s->c];
+	char r[32];
+	
+	cpu_65c02_exec(cpu);
+	
+	/* Let any timer events due by now happen */
+	sched_run(&s->m->sched, s->m->srb1.ccu.core.cycle);
+	
+	s->g = s->c;
+	sprintf(r, "T05thread:%02x;", s->c + 1);
+	_send(s, r);
+}
+
+static int _thread(const char *p)
+{
+	/* 0 or -1 mean any thread */
+	long t = strtol(p, NULL, 16);
+	
+	return(t == 1 || t == 2 ? t - 1 : (t <= 0 ? -1 : -2));
+}
+
+static void _watch_packet(struct gdbstub_t *s, const char *p)
+{
+	static const int types[5] = {
+		WATCH_EXEC, WATCH_EXEC, WATCH_WRITE, WATCH_READ, WATCH_READ | WATCH_WRITE,
+	};
+	struct watch_t *w = s->watch[s->g];
+	int insert = (p[0] == 'Z');
+	int type = p[1] - '0';
+	long addr, len;
+	char *e;
+	int r;
+	
+	if(type < 0 || type > 4 || p[2] != ',')
+	{
+		_send(s, "");
+		return;
+	}
+	
+	addr = strtol(p + 3, &e, 16);
+	len = *e == ',' ? strtol(e + 1, NULL, 16) : 1;
+	
+	/* The length of a breakpoint is its kind, not a range */
+	if(types[type] == WATCH_EXEC || len < 1)
+	{
+		len = 1;
+	}
+	
+	if(addr < 0 || addr + len > 0x10000)
+	{
+		_send(s, "E01");
+		return;
+	}
+	
+	if(insert)
+	{
+		r = watch_add(w, types[type], addr, addr + len - 1);
+	}
+	else
+	{
+		r = watch_remove(w, types[type], addr, addr + len - 1);
+	}
+	
+	_send(s, r == 0 ? "OK" : "E01");
+}
+
+static void _query(struct gdbstub_t *s, const char *p)
+{
+	char r[GDBSTUB_BUF];
+	int i;
+	
+	if(strncmp(p, "qSupported", 10) == 0)
+	{
+		sprintf(r, "PacketSize=%x;qXfer:features:read+", GDBSTUB_BUF - 16);
+		_send(s, r);
+	}
+	else if(strncmp(p, "qXfer:features:read:target.xml:", 31) == 0)
+	{
+		long off, len, n;
+		char *e;
+		
+		off = strtol(p + 31, &e, 16);
+		len = *e == ',' ? strtol(e + 1, NULL, 16) : 0;
+		
+		if(off < 0 || off > (long) sizeof(_target_xml) - 1)
+		{
+			_send(s, "E00");
+			return;
+		}
+		
+		n = (long) sizeof(_target_xml) - 1 - off;
+		
+		if(len < 0) len = 0;
+		if(len > (long) sizeof(r) - 2) len = sizeof(r) - 2;
+		
+		if(n > len)
+		{
+			r[0] = 'm';
+			n = len;
+		}
+		else
+		{
+			r[0] = 'l';
+		}
+		
+		memcpy(r + 1, _target_xml + off, n);
+		r[n + 1] = '\0';
+		_send(s, r);
+	}
+	else if(strcmp(p, "qAttached") == 0)
+	{
+		_send(s, "1");
+	}
+	else if(strcmp(p, "qfThreadInfo") == 0)
+	{
+		_send(s, "m1,2");
+	}
+	else if(strcmp(p, "qsThreadInfo") == 0)
+	{
+		_send(s, "l");
+	}
+	else if(strcmp(p, "qC") == 0)
+	{
+		sprintf(r, "QC%x", s->g + 1);
+		_send(s, r);
+	}
+	else if(strncmp(p, "qThreadExtraInfo,", 17) == 0)
+	{
+		int t = _thread(p + 17);
+		const char *n = _names[t < 0 ? 0 : t];
+		
+		for(i = 0; n[i]; i++)
+		{
+			sprintf(r + i * 2, "%02x", n[i]);
+		}
+		
+		_send(s, r);
+	}
+	else
+	{
+		_send(s, "");
+	}
+}
+
+static void _packet(struct gdbstub_t *s, char *p)
+{
+	struct cpu_65c02_t *cpu = s->cpu[s->g];
+	char r[GDBSTUB_BUF];
+	long addr, len, i;
+	char *e;
+	int t, v;
+	
+	switch(p[0])
+	{
+	case '?':
+		_stop_reply(s);
+		break;
+	
+	case 'q':
+		_query(s, p);
+		break;
+	
+	case 'H':
+		t = _thread(p + 2);
+		
+		if(t == -2)
+		{
+			_send(s, "E01");
+			break;
+		}
+		
+		if(t >= 0)
+		{
+			if(p[1] == 'g') s->g = t;
+			else s->c = t;
+		}
+		
+		_send(s, "OK");
+		break;
+	
+	case 'T':
+		_send(s, _thread(p + 1) >= 0 ? "OK" : "E01");
+		break;
+	
+	case 'g':
+		sprintf(r, "%02x%02x%02x%02x%02x%02x%02x",
+			cpu->a, cpu->x, cpu->y, cpu_65c02_status(cpu), cpu->sp,
+			cpu->pc & 0xFF, cpu->pc >> 8);
+		_send(s, r);
+		break;
+	
+	case 'G':
+		for(i = 0; i < 7 && _byte(p + 1 + i * 2) >= 0; i++);
+		
+		if(i < 7)
+		{
+			_send(s, "E01");
+			break;
+		}
+		
+		cpu->a = _byte(p + 1);
+		cpu->x = _byte(p + 3);
+		cpu->y = _byte(p + 5);
+		cpu_65c02_set_status(cpu, _byte(p + 7));
+		cpu->sp = _byte(p + 9);
+		cpu->pc = _byte(p + 11) | (_byte(p + 13) << 8);
+		_send(s, "OK");
+		break;
+	
+	case 'p':
+		switch(strtol(p + 1, NULL, 16))
+		{
+		case 0: sprintf(r, "%02x", cpu->a); break;
+		case 1: sprintf(r, "%02x", cpu->x); break;
+		case 2: sprintf(r, "%02x", cpu->y); break;
+		case 3: sprintf(r, "%02x", cpu_65c02_status(cpu)); break;
+		case 4: sprintf(r, "%02x", cpu->sp); break;
+		case 5: sprintf(r, "%02x%02x", cpu->pc & 0xFF, cpu->pc >> 8); break;
+		default: strcpy(r, "E01"); break;
+		}
+		
+		_send(s, r);
+		break;
+	
+	case 'P':
+		t = strtol(p + 1, &e, 16);
+		v = *e == '=' ? _byte(e + 1) : -1;
+		
+		if(v < 0 || t < 0 || t > 5 || (t == 5 && _byte(e + 3) < 0))
+		{
+			_send(s, "E01");
+			break;
+		}
+		
+		switch(t)
+		{
+		case 0: cpu->a = v; break;
+		case 1: cpu->x = v; break;
+		case 2: cpu->y = v; break;
+		case 3: cpu_65c02_set_status(cpu, v); break;
+		case 4: cpu->sp = v; break;
+		case 5: cpu->pc = v | (_byte(e + 3) << 8); break;
+		}
+		
+		_send(s, "OK");
+		break;
+	
+	case 'm':
+		addr = strtol(p + 1, &e, 16);
+		len = *e == ',' ? strtol(e + 1, NULL, 16) : 0;
+		
+		if(addr < 0 || addr > 0xFFFF || len < 0)
+		{
+			_send(s, "E01");
+			break;
+		}
+		
+		if(len * 2 >= (long) sizeof(r) - 16)
+		{
+			len = (sizeof(r) - 16) / 2;
+		}
+		
+		for(i = 0; i < len; i++)
+		{
+			sprintf(r + i * 2, "%02x", watch_peek(s->watch[s->g], addr + i));
+		}
+		
+		r[len * 2] = '\0';
+		_send(s, r);
+		break;
+	
+	case 'M':
+		addr = strtol(p + 1, &e, 16);
+		len = *e == ',' ? strtol(e + 1, &e, 16) : 0;
+		
+		if(*e != ':' || addr < 0 || addr > 0xFFFF || len < 0)
+		{
+			_send(s, "E01");
+			break;
+		}
+		
+		for(i = 0; i < len && (v = _byte(e + 1 + i * 2)) >= 0; i++)
+		{
+			watch_poke(s->watch[s->g], addr + i, v);
+		}
+		
+		_send(s, "OK");
+		break;
+	
+	case 'c':
+	case 's':
+		if(p[1])
+		{
+			s->cpu[s->c]->pc = strtol(p + 1, NULL, 16);
+		}
+		
+		if(p[0] == 's')
+		{
+			_step(s);
+			break;
+		}
+		
+		/* The reply comes when something stops the machines */
+		s->running = 1;
+		*s->paused = 0;
+		break;
+	
+	case 'Z':
+	case 'z':
+		_watch_packet(s, p);
+		break;
+	
+	case 'D':
+		_send(s, "OK");
+		_close(s);
+		break;
+	
+	case 'k':
+		*s->quit = 1;
+		_close(s);
+		break;
+	
+	default:
+		_send(s, "");
+		break;
+	}
+}
+
+static void _accept(struct gdbstub_t *s)
+{
+	int fd = accept(s->listen_fd, NULL, NULL);
+	int one = 1;
+	
+	if(fd < 0)
+	{
+		return;
+	}
+	
+	if(s->fd >= 0)
+	{
+		/* One debugger at a time */
+		close(fd);
+		return;
+	}
+	
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	
+	s->fd = fd;
+	s->len = 0;
+	s->running = 0;
+	s->g = s->c = 0;
+	
+	/* The debugger expects to find the target stopped */
+	*s->paused = 1;
+	
+	printf("gdbstub: client connected\n");
+}
+
+int gdbstub_init(struct gdbstub_t *s, const char *addr, struct machine_t *m, struct watch_t *srb1, struct watch_t *acm, int *paused, int *quit)
+{
+	int one = 1;
+	int r;
+	
+	memset(s, 0, sizeof(struct gdbstub_t));
+	s->fd = -1;
+	s->m = m;
+	s->cpu[0] = &m->srb1.ccu.core;
+	s->cpu[1] = &m->acm.cpu;
+	s->watch[0] = srb1;
+	s->watch[1] = acm;
+	s->paused = paused;
+	s->quit = quit;
+	
+	if(strchr(addr, '/'))
+	{
+		/* A UNIX socket path */
+		struct sockaddr_un sa;
+		
+		memset(&sa, 0, sizeof(sa));
+		sa.sun_family = AF_UNIX;
+		strncpy(sa.sun_path, addr, sizeof(sa.sun_path) - 1);
+		unlink(addr);
+		
+		s->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		r = s->listen_fd < 0 ? -1 : bind(s->listen_fd, (struct sockaddr *) &sa, sizeof(sa));
+	}
+	else
+	{
+		/* A TCP port, on the loopback interface only */
+		struct sockaddr_in sa;
+		
+		memset(&sa, 0, sizeof(sa));
+		sa.sin_family = AF_INET;
+		sa.sin_port = htons(atoi(addr));
+		sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		
+		s->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+		if(s->listen_fd >= 0)
+		{
+			setsockopt(s->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		}
+		
+		r = s->listen_fd < 0 ? -1 : bind(s->listen_fd, (struct sockaddr *) &sa, sizeof(sa));
+	}
+	
+	if(r != 0 || listen(s->listen_fd, 1) != 0)
+	{
+		perror("gdbstub");
+		
+		if(s->listen_fd >= 0)
+		{
+			close(s->listen_fd);
+		}
+		
+		return(-1);
+	}
+	
+	fcntl(s->listen_fd, F_SETFL, O_NONBLOCK);
+	
+	printf("gdbstub: listening on %s\n", addr);
+	
+	return(0);
+}
+
+void gdbstub_poll(struct gdbstub_t *s)
+{
+	char *p, *end;
+	int r;
+	
+	if(s->fd < 0)
+	{
+		_accept(s);
+		return;
+	}
+	
+	r = recv(s->fd, s->buf + s->len, sizeof(s->buf) - s->len - 1, 0);
+	
+	if(r == 0 || (r < 0 && errno != EAGAIN && errno != EINTR))
+	{
+		_close(s);
+		return;
+	}
+	
+	if(r > 0)
+	{
+		s->len += r;
+		s->buf[s->len] = '\0';
+	}
+	
+	/* Handle every complete packet in the buffer */
+	p = s->buf;
+	
+	while(s->fd >= 0 && p < s->buf + s->len)
+	{
+		if(*p == 0x03)
+		{
+			/* Interrupt */
+			*s->paused = 1;
+			p++;
+		}
+		else if(*p != '$')
+		{
+			/* Acks and noise */
+			p++;
+		}
+		else if((end = memchr(p, '#', s->buf + s->len - p)) && end + 2 < s->buf + s->len)
+		{
+			*end = '\0';
+			_send_raw(s, "+", 1);
+			_packet(s, p + 1);
+			p = end + 3;
+		}
+		else
+		{
+			break;
+		}
+	}
+	
+	if(s->fd < 0)
+	{
+		return;
+	}
+	
+	s->len -= p - s->buf;
+	memmove(s->buf, p, s->len);
+	
+	if(s->len == sizeof(s->buf) - 1)
+	{
+		/* Too long to be a packet */
+		s->len = 0;
+	}
+	
+	/* Something stopped the machines while the client waited */
+	if(s->running && *s->paused)
+	{
+		_stop_reply(s);
+	}
+}
+
+void gdbstub_free(struct gdbstub_t *s)
+{
+	if(s->fd >= 0)
+	{
+		close(s->fd);
+	}
+	
+	close(s->listen_fd);
+}
+
@@ -0,0 +1,58 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef _GDBSTUB_H
+#define _GDBSTUB_H
+
+#include "machine.h"
+#include "watch.h"
+
+#define GDBSTUB_BUF 0x1000
+
+/* GDB remote serial protocol server. The SRB1 is thread 1 and the
+ * ACM thread 2, each with the registers a, x, y, p, sp (8 bit) and
+ * pc (16 bit) in that order. Breakpoints and memory access apply to
+ * the thread selected with Hg, as the CPUs don't share memory */
+struct gdbstub_t {
+	int listen_fd;
+	int fd;
+	
+	struct machine_t *m;
+	struct cpu_65c02_t *cpu[2];
+	struct watch_t *watch[2];
+	
+	/* The emulator's pause and quit flags */
+	int *paused;
+	int *quit;
+	
+	/* Threads selected for registers/memory (Hg) and stepping (Hc) */
+	int g;
+	int c;
+	
+	/* Set while the client waits for a stop reply */
+	int running;
+	
+	char buf[GDBSTUB_BUF];
+	int len;
+};
+
+extern int gdbstub_init(struct gdbstub_t *s, const char *addr, struct machine_t *m, struct watch_t *srb1, struct watch_t *acm, int *paused, int *quit);
+extern void gdbstub_poll(struct gdbstub_t *s);
+extern void gdbstub_free(struct gdbstub_t *s);
+
+#endif
+
@@ -0,0 +1,508 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hle.h"
+#include "log.h"
+
+/* FNV-1a hash of the V1.50 ACM ROM */
+#define _ACM_V150 0x94BCDC4B766E954EULL
+
+/* Longest the interpreter may take over a routine in the self-check */
+#define _CHECK_MAX 1000000
+
+/* Everything in the ACM a hook might change */
+struct hle_copy_t {
+	struct cpu_65c02_t cpu;
+	uint8_t ram[0x2000];
+	uint8_t osd[0x200];
+	uint16_t osd_ptr;
+	uint64_t io_reads[0x6000];
+	uint64_t io_writes[0x6000];
+};
+
+static void _io_write(struct acm_system_t *s, uint16_t addr, uint8_t v)
+{
+	/* Through the handler, so the OSD and the access counts follow */
+	s->mem.write(s->mem.private, addr, v);
+}
+
+static uint8_t _adc_v(uint8_t a, uint8_t m, uint16_t sum)
+{
+	return((~(a ^ m) & (a ^ sum) & 0x80) ? 1 : 0);
+}
+
+/* The fill at $DAA6 behind the screen clears at $D048, $D051 and $D8E8.
+ * It homes the cursor and writes 16 rows of the character in $71
+ * followed by 31 of the one in $6A through the put-character routine at
+ * $DA4B, which sends them to RAM at $10BE + cursor instead of the OSD
+ * from cursor $1C0 on if bit 7 of $31 is set. Ends on the RTS at $DAC6 */
+static int _osd_fill(struct acm_system_t *s)
+{
+	struct cpu_65c02_t *cpu = &s->cpu;
+	uint8_t *ram = s->ram;
+	uint8_t sp = cpu->sp;
+	uint64_t cycles;
+	uint32_t writes;
+	uint16_t cursor;
+	uint16_t sum;
+	uint8_t ret = 0x73;
+	uint8_t v = 0x00;
+	int row, col;
+	
+	/* The routine's ADCs are binary, and its stack must not wrap */
+	if(cpu->d || sp < 5)
+	{
+		return(-1);
+	}
+	
+	/* JSR $BB73 and JSR $DAEC home the cursor, then LDX #$10 */
+	cycles = 18 + 45 + 2;
+	writes = 4 + 5;
+	_io_write(s, 0x4000, 0x00);
+	_io_write(s, 0x4001, 0x00);
+	
+	for(cursor = 0, row = 0; row < 16; row++)
+	{
+		for(col = 0; col < 32; col++, cursor++)
+		{
+			if(col == 0)
+			{
+				/* LDA $71 */
+				v = ram[0x71];
+				cycles += 3;
+			}
+			else if(col == 1)
+			{
+				/* LDY #$1F, LDA $6A */
+				v = ram[0x6A];
+				cycles += 2 + 3;
+			}
+			
+			/* JSR $DA4B, PHX, BBR7 $31 */
+			cycles += 6 + 3 + 5;
+			writes += 3;
+			ret = 0x73;
+			
+			if(ram[0x31] & 0x80)
+			{
+				/* LDX $76, CPX #$01, BCC */
+				cpu->c = (cursor >> 8) >= 0x01;
+				cycles += 3 + 2 + (cpu->c ? 2 : 3);
+				
+				if(cpu->c)
+				{
+					/* LDX $75, CPX #$C0, BCC */
+					cpu->c = (cursor & 0xFF) >= 0xC0;
+					cycles += 3 + 2 + (cpu->c ? 2 : 3);
+				}
+				
+				if(cpu->c)
+				{
+					/* TAX, CLC, LDA #$BE, ADC $75, STA $5C, LDA #$10,
+					 * ADC $76, STA $5D, TXA, STA ($5C) */
+					sum = 0xBE + (cursor & 0xFF);
+					cpu->v = _adc_v(0xBE, cursor & 0xFF, sum);
+					ram[0x5C] = sum & 0xFF;
+					
+					sum = 0x10 + (cursor >> 8) + (sum >> 8);
+					cpu->v = _adc_v(0x10, cursor >> 8, sum);
+					cpu->c = sum >> 8;
+					ram[0x5D] = sum & 0xFF;
+					
+					ram[ram[0x5C] | (ram[0x5D] << 8)] = v;
+					cycles += 2 + 2 + 2 + 3 + 3 + 2 + 3 + 3 + 2 + 5;
+					writes += 3;
+					ret = 0x6E;
+				}
+			}
+			
+			/* JSR $DE2C: INC $75, BNE, INC $76 if it wrapped, RTS */
+			if((cursor & 0xFF) == 0xFF)
+			{
+				cycles += 6 + 5 + 2 + 5 + 6;
+				writes += 4;
+			}
+			else
+			{
+				cycles += 6 + 5 + 3 + 6;
+				writes += 3;
+			}
+			
+			if(ret == 0x73)
+			{
+				/* STA $4002 */
+				_io_write(s, 0x4002, v);
+				cycles += 4;
+				writes += 1;
+			}
+			
+			/* PLX, RTS */
+			cycles += 4 + 6;
+			
+			if(col > 0)
+			{
+				/* DEY, BNE */
+				cycles += 2 + (col < 31 ? 3 : 2);
+			}
+		}
+		
+		/* DEX, BNE */
+		cycles += 2 + (row < 15 ? 3 : 2);
+	}
+	
+	/* JSR $BB73 and JSR $DAEC again */
+	cycles += 18 + 45;
+	writes += 4 + 5;
+	ram[0x75] = 0x00;
+	ram[0x76] = 0x00;
+	_io_write(s, 0x4000, 0x00);
+	_io_write(s, 0x4001, 0x00);
+	
+	/* What the last calls left below the stack pointer: the return
+	 * address of JSR $DAEC and its PHA, and of the JSR $DE2C before */
+	ram[0x100 + sp - 0] = 0xDA;
+	ram[0x100 + sp - 1] = 0xC5;
+	ram[0x100 + sp - 2] = v;
+	ram[0x100 + sp - 3] = 0xDA;
+	ram[0x100 + sp - 4] = ret;
+	
+	/* A is the last character again after the PLA, X and Y count down */
+	cpu->a = v;
+	cpu->x = 0x00;
+	cpu->y = 0x00;
+	cpu->nr = v;
+	cpu->zr = v;
+	cpu->pc = 0xDAC6;
+	cpu->cycle += cycles;
+	cpu->writes += writes;
+	
+	/* The RTS from $DAEC is a short jump back, so the idle loop check
+	 * last ran there. It can't have matched, the one before was at $DAB7 */
+	cpu->idle = 0;
+	cpu->idle_pc = cpu->pc;
+	cpu->idle_writes = cpu->writes;
+	cpu->idle_volatile_reads = cpu->volatile_reads;
+	cpu->idle_cycle = cpu->cycle;
+	cpu->idle_regs[0] = cpu->a;
+	cpu->idle_regs[1] = cpu->x;
+	cpu->idle_regs[2] = cpu->y;
+	cpu->idle_regs[3] = cpu->sp;
+	cpu->idle_regs[4] = cpu_65c02_status(cpu);
+	
+	return(0);
+}
+
+const struct hle_hook_t hle_hooks[] = {
+	{ "osd_fill", "OSD screen fill used by the screen clears", _ACM_V150, 0xDAA6, 0xDAC6, &_osd_fill },
+	{ NULL },
+};
+
+static void _copy_save(struct acm_system_t *s, struct hle_copy_t *c)
+{
+	c->cpu = s->cpu;
+	memcpy(c->ram, s->ram, 0x2000);
+	if(s->osd) memcpy(c->osd, s->osd, 0x200);
+	c->osd_ptr = s->osd_ptr;
+	memcpy(c->io_reads, s->io_reads, sizeof(c->io_reads));
+	memcpy(c->io_writes, s->io_writes, sizeof(c->io_writes));
+}
+
+static void _copy_load(struct acm_system_t *s, const struct hle_copy_t *c)
+{
+	s->cpu = c->cpu;
+	memcpy(s->ram, c->ram, 0x2000);
+	if(s->osd) memcpy(s->osd, c->osd, 0x200);
+	s->osd_ptr = c->osd_ptr;
+	memcpy(s->io_reads, c->io_reads, sizeof(c->io_reads));
+	memcpy(s->io_writes, c->io_writes, sizeof(c->io_writes));
+}
+
+static int _field(const char *hook, const char *name, uint64_t interpreted, uint64_t native)
+{
+	if(interpreted == native)
+	{
+		return(0);
+	}
+	
+	log_printf(LOG_CPU, LOG_ERROR, "hle: %s: %s is %lu interpreted, %lu native\n", hook, name, interpreted, native);
+	
+	return(1);
+}
+
+static int _bytes(const char *hook, const char *name, const uint8_t *interpreted, const uint8_t *native, int len)
+{
+	int i;
+	
+	for(i = 0; i < len && interpreted[i] == native[i]; i++);
+	
+	if(i == len)
+	{
+		return(0);
+	}
+	
+	log_printf(LOG_CPU, LOG_ERROR, "hle: %s: %s+$%04X is $%02X interpreted, $%02X native\n", hook, name, i, interpreted[i], native[i]);
+	
+	return(1);
+}
+
+static int _counts(const char *hook, const char *name, const uint64_t *interpreted, const uint64_t *native)
+{
+	int i;
+	
+	for(i = 0; i < 0x6000 && interpreted[i] == native[i]; i++);
+	
+	if(i == 0x6000)
+	{
+		return(0);
+	}
+	
+	log_printf(LOG_CPU, LOG_ERROR, "hle: %s: %s of $%04X are %lu interpreted, %lu native\n", hook, name, 0x2000 + i, interpreted[i], native[i]);
+	
+	return(1);
+}
+
+/* Compare the interpreted result in the ACM with the native one. The bus
+ * timestamps are left out, they only mean something inside a handler */
+static int _compare(const char *hook, struct acm_system_t *s, struct hle_copy_t *c)
+{
+	struct cpu_65c02_t *a = &s->cpu;
+	struct cpu_65c02_t *b = &c->cpu;
+	int d = 0;
+	
+	d += _field(hook, "pc", a->pc, b->pc);
+	d += _field(hook, "a", a->a, b->a);
+	d += _field(hook, "x", a->x, b->x);
+	d += _field(hook, "y", a->y, b->y);
+	d += _field(hook, "sp", a->sp, b->sp);
+	d += _field(hook, "p", cpu_65c02_status(a), cpu_65c02_status(b));
+	d += _field(hook, "cycle", a->cycle, b->cycle);
+	d += _field(hook, "writes", a->writes, b->writes);
+	d += _field(hook, "depth", a->depth, b->depth);
+	d += _field(hook, "faults", a->faults, b->faults);
+	d += _field(hook, "idle", a->idle, b->idle);
+	d += _field(hook, "idle_pc", a->idle_pc, b->idle_pc);
+	d += _field(hook, "idle_writes", a->idle_writes, b->idle_writes);
+	d += _field(hook, "idle_volatile_reads", a->idle_volatile_reads, b->idle_volatile_reads);
+	d += _field(hook, "idle_cycle", a->idle_cycle, b->idle_cycle);
+	d += _bytes(hook, "idle_regs", a->idle_regs, b->idle_regs, sizeof(a->idle_regs));
+	d += _bytes(hook, "ram", s->ram, c->ram, 0x2000);
+	if(s->osd) d += _bytes(hook, "osd", s->osd, c->osd, 0x200);
+	d += _field(hook, "osd_ptr", s->osd_ptr, c->osd_ptr);
+	d += _counts(hook, "reads", s->io_reads, c->io_reads);
+	d += _counts(hook, "writes", s->io_writes, c->io_writes);
+	
+	return(d);
+}
+
+static int _check(struct hle_t *s, int i)
+{
+	const struct hle_hook_t *h = s->hook[i];
+	struct cpu_65c02_t *cpu = &s->acm->cpu;
+	uint8_t sp = cpu->sp;
+	int n;
+	
+	_copy_save(s->acm, s->before);
+	
+	if(h->run(s->acm) != 0)
+	{
+		return(0);
+	}
+	
+	/* Go back and interpret the routine too. Its result is the one kept */
+	_copy_save(s->acm, s->native);
+	_copy_load(s->acm, s->before);
+	
+	for(n = 0; n < _CHECK_MAX && (cpu->pc != h->end || cpu->sp != sp); n++)
+	{
+		cpu_65c02_exec(cpu);
+	}
+	
+	s->calls[i]++;
+	
+	if(n == _CHECK_MAX)
+	{
+		log_printf(LOG_CPU, LOG_ERROR, "hle: %s: the interpreter didn't reach $%04X\n", h->name, h->end);
+		s->mismatches[i]++;
+	}
+	else if(_compare(h->name, s->acm, s->native) != 0)
+	{
+		s->mismatches[i]++;
+	}
+	
+	return(1);
+}
+
+static int _enable(struct hle_t *s, const struct hle_hook_t *h, int mode)
+{
+	int i;
+	
+	for(i = 0; i < s->count && s->hook[i] != h; i++);
+	
+	if(i == HLE_HOOKS_MAX)
+	{
+		return(-1);
+	}
+	
+	if(i == s->count)
+	{
+		s->hook[s->count++] = h;
+	}
+	
+	s->mode[i] = mode;
+	s->page[h->pc >> 8] = 1;
+	
+	return(0);
+}
+
+/* Enable the hooks in spec, "<name>[:check],..." or "all[:check]". Hooks
+ * written for another firmware are left off */
+int hle_init(struct hle_t *s, struct acm_system_t *acm, const char *spec)
+{
+	const struct hle_hook_t *h;
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	const char *p = spec;
+	const char *e;
+	size_t n;
+	int mode;
+	int found;
+	int i;
+	
+	memset(s, 0, sizeof(struct hle_t));
+	s->acm = acm;
+	
+	for(i = 0; i < 0x8000; i++)
+	{
+		hash = (hash ^ acm->rom[i]) * 0x100000001B3ULL;
+	}
+	
+	while(p && *p)
+	{
+		e = strchr(p, ',');
+		n = e ? (size_t) (e - p) : strlen(p);
+		mode = HLE_NATIVE;
+		
+		if(n > 6 && strncmp(p + n - 6, ":check", 6) == 0)
+		{
+			mode = HLE_CHECK;
+			n -= 6;
+		}
+		
+		for(found = 0, h = hle_hooks; h->name; h++)
+		{
+			if(!(n == 3 && strncmp(p, "all", 3) == 0) &&
+			   !(n == strlen(h->name) && strncmp(p, h->name, n) == 0))
+			{
+				continue;
+			}
+			
+			found = 1;
+			
+			if(h->rom_hash != hash)
+			{
+				log_printf(LOG_CPU, LOG_INFO, "hle: %s is for another ACM firmware, left off\n", h->name);
+				continue;
+			}
+			
+			if(_enable(s, h, mode) != 0)
+			{
+				return(-1);
+			}
+		}
+		
+		if(!found)
+		{
+			return(-1);
+		}
+		
+		p = e ? e + 1 : NULL;
+	}
+	
+	for(i = 0; i < s->count && s->mode[i] != HLE_CHECK; i++);
+	
+	if(i < s->count)
+	{
+		s->before = malloc(sizeof(struct hle_copy_t));
+		s->native = malloc(sizeof(struct hle_copy_t));
+		
+		if(!s->before || !s->native)
+		{
+			hle_free(s);
+			return(-1);
+		}
+	}
+	
+	return(0);
+}
+
+/* Run the routine at the ACM's PC natively if a hook is enabled for it.
+ * Returns 1 if it ran, or 0 to interpret the next instruction as usual */
+int hle_exec(struct hle_t *s)
+{
+	struct cpu_65c02_t *cpu = &s->acm->cpu;
+	int i;
+	
+	for(i = 0; i < s->count && s->hook[i]->pc != cpu->pc; i++);
+	
+	/* A profile or trace wants to see every instruction */
+	if(i == s->count || cpu->prof || cpu->verbose)
+	{
+		return(0);
+	}
+	
+	if(s->mode[i] == HLE_CHECK)
+	{
+		return(_check(s, i));
+	}
+	
+	if(s->hook[i]->run(s->acm) != 0)
+	{
+		return(0);
+	}
+	
+	s->calls[i]++;
+	
+	return(1);
+}
+
+void hle_dump(struct hle_t *s)
+{
+	int i;
+	
+	for(i = 0; i < s->count; i++)
+	{
+		if(s->mode[i] == HLE_CHECK)
+		{
+			printf("hle: %s: %lu calls checked, %lu mismatches\n", s->hook[i]->name, s->calls[i], s->mismatches[i]);
+		}
+		else
+		{
+			printf("hle: %s: %lu calls\n", s->hook[i]->name, s->calls[i]);
+		}
+	}
+}
+
+void hle_free(struct hle_t *s)
+{
+	free(s->before);
+	free(s->native);
+	s->before = NULL;
+	s->native = NULL;
+}
+
@@ -0,0 +1,73 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef _HLE_H
+#define _HLE_H
+
+#include <stdint.h>
+#include "machine.h"
+
+#define HLE_HOOKS_MAX 8
+
+/* Modes of an enabled hook */
+#define HLE_NATIVE 1 /* Run the native code only */
+#define HLE_CHECK  2 /* Run the routine both ways and compare the results */
+
+/* A known ACM firmware routine with a native replacement. The hook is
+ * called with the CPU at pc and must leave the machine as if the
+ * instructions up to end had been interpreted, down to the cycle count.
+ * It returns -1 without changing anything to have the routine
+ * interpreted instead */
+struct hle_hook_t {
+	const char *name;
+	const char *description;
+	uint64_t rom_hash;
+	uint16_t pc;
+	uint16_t end;
+	int (*run)(struct acm_system_t *s);
+};
+
+extern const struct hle_hook_t hle_hooks[];
+
+struct hle_copy_t;
+
+struct hle_t {
+	struct acm_system_t *acm;
+	
+	/* The enabled hooks, their modes and what they've done */
+	int count;
+	const struct hle_hook_t *hook[HLE_HOOKS_MAX];
+	int mode[HLE_HOOKS_MAX];
+	uint64_t calls[HLE_HOOKS_MAX];
+	uint64_t mismatches[HLE_HOOKS_MAX];
+	
+	/* Pages holding the entry point of an enabled hook, so the test
+	 * before each instruction is a single lookup */
+	uint8_t page[0x100];
+	
+	/* Copies of the ACM taken for the self-check */
+	struct hle_copy_t *before;
+	struct hle_copy_t *native;
+};
+
+extern int hle_init(struct hle_t *s, struct acm_system_t *acm, const char *spec);
+extern int hle_exec(struct hle_t *s);
+extern void hle_dump(struct hle_t *s);
+extern void hle_free(struct hle_t *s);
+
+#endif
+
@@ -0,0 +1,199 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+#include "hoststat.h"
+
+static const char *_cat_names[HOSTSTAT_MAX] = {
+	"core", "io", "sched", "ui", "sleep",
+};
+
+static int _perf_open(uint64_t config, int group)
+{
+	struct perf_event_attr attr;
+	
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = config;
+	attr.read_format = PERF_FORMAT_GROUP;
+	attr.disabled = (group == -1 ? 1 : 0);
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	
+	/* This thread only, any CPU */
+	return(syscall(__NR_perf_event_open, &attr, 0, -1, group, 0));
+}
+
+int hoststat_init(struct hoststat_t *s, const char *name)
+{
+	int fd;
+	
+	memset(s, 0, sizeof(struct hoststat_t));
+	s->page = &s->local;
+	
+	/* Hardware counters, may well not be permitted */
+	s->perf_fd = _perf_open(PERF_COUNT_HW_CPU_CYCLES, -1);
+	if(s->perf_fd >= 0)
+	{
+		if(_perf_open(PERF_COUNT_HW_CACHE_MISSES, s->perf_fd) < 0)
+		{
+			close(s->perf_fd);
+			s->perf_fd = -1;
+		}
+		else
+		{
+			ioctl(s->perf_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+		}
+	}
+	
+	if(s->perf_fd < 0)
+	{
+		fprintf(stderr, "hoststat: no hardware counters: %s\n", strerror(errno));
+	}
+	
+	/* Publish the counters as a shared memory page */
+	if(name)
+	{
+		snprintf(s->name, sizeof(s->name), "%s", name);
+		
+		fd = shm_open(s->name, O_CREAT | O_RDWR, 0644);
+		if(fd < 0)
+		{
+			perror(s->name);
+			hoststat_free(s);
+			return(-1);
+		}
+		
+		if(ftruncate(fd, sizeof(struct hoststat_page_t)) < 0)
+		{
+			perror(s->name);
+			close(fd);
+			shm_unlink(s->name);
+			hoststat_free(s);
+			return(-1);
+		}
+		
+		s->page = mmap(NULL, sizeof(struct hoststat_page_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		
+		if(s->page == MAP_FAILED)
+		{
+			perror(s->name);
+			shm_unlink(s->name);
+			s->page = &s->local;
+			hoststat_free(s);
+			return(-1);
+		}
+		
+		memset(s->page, 0, sizeof(struct hoststat_page_t));
+	}
+	
+	s->page->version = 1;
+	s->page->perf = (s->perf_fd >= 0 ? 1 : 0);
+	
+	return(0);
+}
+
+void hoststat_free(struct hoststat_t *s)
+{
+	if(s->page != &s->local)
+	{
+		munmap(s->page, sizeof(struct hoststat_page_t));
+		shm_unlink(s->name);
+	}
+	
+	if(s->perf_fd >= 0)
+	{
+		close(s->perf_fd);
+	}
+}
+
+void hoststat_slice(struct hoststat_t *s, const int64_t *ns, uint64_t srb1_cycle, uint64_t acm_cycle)
+{
+	struct hoststat_page_t *p = s->page;
+	uint64_t v[3];
+	int i;
+	
+	/* Odd while updating. The fence keeps the updates below from
+	 * being seen before seq is */
+	__atomic_store_n(&p->seq, p->seq + 1, __ATOMIC_RELEASE);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	
+	/* The handlers ran inside the cores */
+	for(i = 0; i < HOSTSTAT_MAX; i++)
+	{
+		p->ns[i] += ns[i];
+	}
+	
+	p->ns[HOSTSTAT_CORE] -= s->io_ns;
+	p->ns[HOSTSTAT_IO] += s->io_ns;
+	p->io_calls += s->io_calls;
+	s->io_ns = 0;
+	s->io_calls = 0;
+	
+	/* Reading the group gives { nr, cycles, cache misses } */
+	if(s->perf_fd >= 0 && read(s->perf_fd, v, sizeof(v)) == sizeof(v))
+	{
+		p->host_cycles = v[1];
+		p->cache_misses = v[2];
+	}
+	
+	p->srb1_cycle = srb1_cycle;
+	p->acm_cycle = acm_cycle;
+	p->slices++;
+	
+	__atomic_store_n(&p->seq, p->seq + 1, __ATOMIC_RELEASE);
+}
+
+void hoststat_dump(struct hoststat_t *s)
+{
+	struct hoststat_page_t *p = s->page;
+	uint64_t total = 0;
+	int i;
+	
+	for(i = 0; i < HOSTSTAT_MAX; i++)
+	{
+		total += p->ns[i];
+	}
+	
+	fprintf(stderr, "hoststat: %lu slices, %lu I/O handler calls\n", p->slices, p->io_calls);
+	
+	for(i = 0; i < HOSTSTAT_MAX; i++)
+	{
+		fprintf(stderr, "hoststat: %-5s %10.3f ms %6.2f%%\n",
+			_cat_names[i],
+			p->ns[i] / 1e6,
+			total ? 100.0 * p->ns[i] / total : 0.0
+		);
+	}
+	
+	if(p->perf)
+	{
+		fprintf(stderr, "hoststat: %lu host cycles, %lu cache misses\n", p->host_cycles, p->cache_misses);
+	}
+}
+
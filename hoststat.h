@@ -0,0 +1,114 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef _HOSTSTAT_H
+#define _HOSTSTAT_H
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+/* Where the host time goes */
+enum hoststat_cat_t {
+	HOSTSTAT_CORE,	/* CPU cores, less the I/O handlers */
+	HOSTSTAT_IO,	/* I/O memory handlers */
+	HOSTSTAT_SCHED,	/* Scheduled events */
+	HOSTSTAT_UI,	/* Input and display glue */
+	HOSTSTAT_SLEEP,	/* Waiting for real time */
+	HOSTSTAT_MAX
+};
+
+/* Live counters, published on a shared memory page. Readers should
+ * retry if seq is odd or changes while they are reading, as
+ * hoststat_read() does */
+struct hoststat_page_t {
+	uint32_t version;
+	uint32_t seq;
+	
+	uint64_t slices;
+	uint64_t ns[HOSTSTAT_MAX];
+	uint64_t io_calls;
+	
+	/* Hardware counters for the emulation thread, if available */
+	int32_t perf;
+	uint64_t host_cycles;
+	uint64_t cache_misses;
+	
+	/* Emulated time */
+	uint64_t srb1_cycle;
+	uint64_t acm_cycle;
+};
+
+struct hoststat_t {
+	int perf_fd;
+	struct hoststat_page_t *page;
+	struct hoststat_page_t local;
+	char name[64];
+	
+	/* Time spent in and calls to handlers since the last slice */
+	int64_t io_ns;
+	uint64_t io_calls;
+};
+
+extern int hoststat_init(struct hoststat_t *s, const char *name);
+extern void hoststat_free(struct hoststat_t *s);
+extern void hoststat_slice(struct hoststat_t *s, const int64_t *ns, uint64_t srb1_cycle, uint64_t acm_cycle);
+extern void hoststat_dump(struct hoststat_t *s);
+
+static inline int64_t hoststat_now(void)
+{
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	return((int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+static inline int64_t hoststat_lap(int64_t *t)
+{
+	/* Time since *t, and restart from now */
+	int64_t now = hoststat_now();
+	int64_t d = now - *t;
+	
+	*t = now;
+	
+	return(d);
+}
+
+static inline void hoststat_io(struct hoststat_t *s, int64_t ns)
+{
+	s->io_ns += ns;
+	s->io_calls++;
+}
+
+static inline void hoststat_read(const struct hoststat_page_t *p, struct hoststat_page_t *v)
+{
+	uint32_t seq;
+	
+	/* Copy the page until no update overlapped the copy. The fence
+	 * keeps the copy from being read after the second seq load */
+	do
+	{
+		seq = __atomic_load_n(&p->seq, __ATOMIC_ACQUIRE);
+		memcpy(v, p, sizeof(struct hoststat_page_t));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	}
+	while((seq & 1) || __atomic_load_n(&p->seq, __ATOMIC_RELAXED) != seq);
+}
+
+#endif
+
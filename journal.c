@@ -0,0 +1,210 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "journal.h"
+
+#define _MAGIC   "SRB1JRNL"
+#define _VERSION 1
+
+static void _flush(struct journal_t *s)
+{
+	if(s->len > 0 && fwrite(s->buf, 1, s->len, s->f) != s->len)
+	{
+		perror("journal");
+	}
+	
+	s->len = 0;
+}
+
+static void _put(struct journal_t *s, uint8_t v)
+{
+	if(s->len == JOURNAL_BUFFER)
+	{
+		_flush(s);
+	}
+	
+	s->buf[s->len++] = v;
+}
+
+static int _get(struct journal_t *s)
+{
+	if(s->pos == s->len)
+	{
+		s->len = fread(s->buf, 1, JOURNAL_BUFFER, s->f);
+		s->pos = 0;
+		
+		if(s->len <= 0)
+		{
+			s->len = 0;
+			return(-1);
+		}
+	}
+	
+	return(s->buf[s->pos++]);
+}
+
+/* The header: magic, version, the machine_hash() of the machine it was
+ * recorded on and the SRB1 cycle recording started at */
+static void _header(uint8_t *h, uint64_t hash, uint64_t cycle)
+{
+	int i;
+	
+	memcpy(h, _MAGIC, 8);
+	h[8] = _VERSION;
+	
+	for(i = 0; i < 8; i++)
+	{
+		h[9 + i] = hash >> (i * 8);
+		h[17 + i] = cycle >> (i * 8);
+	}
+}
+
+/* Start recording to path, from cycle */
+int journal_record(struct journal_t *s, const char *path, uint64_t hash, uint64_t cycle)
+{
+	uint8_t h[25];
+	
+	memset(s, 0, sizeof(struct journal_t));
+	
+	s->f = fopen(path, "wb");
+	if(!s->f)
+	{
+		perror(path);
+		return(-1);
+	}
+	
+	_header(h, hash, cycle);
+	fwrite(h, 1, sizeof(h), s->f);
+	
+	s->cycle = cycle;
+	s->next = UINT64_MAX;
+	
+	return(0);
+}
+
+/* Open a journal for replay on a machine at cycle, and read the first
+ * record. The machine must match the one it was recorded on, though it
+ * may have started later if nothing happened in between */
+int journal_replay(struct journal_t *s, const char *path, uint64_t hash, uint64_t cycle)
+{
+	uint8_t h[25];
+	uint8_t e[25];
+	uint64_t start = 0;
+	int i;
+	
+	memset(s, 0, sizeof(struct journal_t));
+	s->replay = 1;
+	
+	s->f = fopen(path, "rb");
+	if(!s->f)
+	{
+		perror(path);
+		return(-1);
+	}
+	
+	if(fread(h, 1, sizeof(h), s->f) != sizeof(h))
+	{
+		memset(h, 0, sizeof(h));
+	}
+	
+	for(i = 0; i < 8; i++)
+	{
+		start |= (uint64_t) h[17 + i] << (i * 8);
+	}
+	
+	_header(e, hash, start);
+	
+	if(memcmp(h, e, sizeof(h)) != 0)
+	{
+		fprintf(stderr, "%s: not a journal for this machine\n", path);
+		fclose(s->f);
+		return(-1);
+	}
+	
+	s->cycle = start;
+	journal_read(s);
+	
+	if(s->next < cycle)
+	{
+		fprintf(stderr, "%s: starts at cycle %lu, before the machine\n", path, start);
+		fclose(s->f);
+		return(-1);
+	}
+	
+	return(0);
+}
+
+/* Append a record */
+void journal_write(struct journal_t *s, uint64_t cycle, int type, uint8_t value)
+{
+	uint64_t d = cycle - s->cycle;
+	
+	while(d >= 0x80)
+	{
+		_put(s, 0x80 | (d & 0x7F));
+		d >>= 7;
+	}
+	
+	_put(s, d);
+	_put(s, type);
+	_put(s, value);
+	
+	s->cycle = cycle;
+}
+
+/* Move on to the next record when replaying */
+void journal_read(struct journal_t *s)
+{
+	uint64_t d = 0;
+	int i, v, t;
+	
+	for(i = 0; (v = _get(s)) >= 0x80 && i < 63; i += 7)
+	{
+		d |= (uint64_t) (v & 0x7F) << i;
+	}
+	
+	t = _get(s);
+	
+	if(v < 0 || t < 0)
+	{
+		/* Past the end, or a journal cut short */
+		s->next = UINT64_MAX;
+		s->type = JOURNAL_END;
+		return;
+	}
+	
+	s->cycle += (uint64_t) v << i | d;
+	s->next = s->cycle;
+	s->type = t;
+	s->value = _get(s);
+}
+
+/* Finish recording with an end record at cycle, or stop replaying */
+void journal_close(struct journal_t *s, uint64_t cycle)
+{
+	if(!s->replay)
+	{
+		journal_write(s, cycle, JOURNAL_END, 0);
+		_flush(s);
+	}
+	
+	fclose(s->f);
+}
+
@@ -0,0 +1,60 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef _JOURNAL_H
+#define _JOURNAL_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define JOURNAL_BUFFER 0x10000
+
+/* Record types */
+#define JOURNAL_END     0 /* The end of the session */
+#define JOURNAL_BUTTONS 1 /* Front panel buttons, port 6 (pressed = 0) */
+
+/* A journal of every input from outside the machine, by SRB1 cycle.
+ * Each record is the cycles since the last as a 7-bit varint, a type
+ * and a value byte. Replaying it against a machine that started from
+ * the same state gives the same run */
+struct journal_t {
+	FILE *f;
+	int replay;
+	
+	/* Cycle of the last record */
+	uint64_t cycle;
+	
+	/* Buffered records */
+	uint8_t buf[JOURNAL_BUFFER];
+	int len;
+	int pos;
+	
+	/* The next record when replaying. next is its cycle, or UINT64_MAX
+	 * once past the end */
+	uint64_t next;
+	int type;
+	uint8_t value;
+};
+
+extern int journal_record(struct journal_t *s, const char *path, uint64_t hash, uint64_t cycle);
+extern int journal_replay(struct journal_t *s, const char *path, uint64_t hash, uint64_t cycle);
+extern void journal_write(struct journal_t *s, uint64_t cycle, int type, uint8_t value);
+extern void journal_read(struct journal_t *s);
+extern void journal_close(struct journal_t *s, uint64_t cycle);
+
+#endif
+
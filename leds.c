@@ -0,0 +1,95 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include <string.h>
+#include "leds.h"
+
+static void _advance(struct leds_t *s, uint64_t cycle)
+{
+	uint64_t n;
+	int d, i;
+	
+	/* An instruction can run a little past a frame event */
+	if(cycle <= s->cycle)
+	{
+		return;
+	}
+	
+	n = cycle - s->cycle;
+	
+	for(d = 0; d < LEDS_DIGITS; d++)
+	{
+		for(i = 0; s->lit[d] >> i; i++)
+		{
+			if(s->lit[d] & (1 << i))
+			{
+				s->on[d][i] += n;
+			}
+		}
+	}
+	
+	s->cycle = cycle;
+}
+
+static void _frame_event(void *private, uint64_t cycle)
+{
+	struct leds_t *s = private;
+	uint64_t n, v;
+	int d, i;
+	
+	_advance(s, cycle);
+	
+	n = s->cycle - s->frame;
+	
+	for(d = 0; d < LEDS_DIGITS && n; d++)
+	{
+		for(i = 0; i < 8; i++)
+		{
+			/* Each digit can be lit for at most its share of the time */
+			v = s->on[d][i] * 255 * LEDS_DIGITS / n;
+			s->out[d][i] = v > 255 ? 255 : v;
+			s->on[d][i] = 0;
+		}
+	}
+	
+	s->frame = s->cycle;
+	
+	sched_add(s->sched, cycle + s->period, &_frame_event, s);
+}
+
+/* Start the first frame at cycle. Frames end on multiples of the
+ * period, so they fall at the same points however the run started */
+void leds_init(struct leds_t *s, struct sched_t *sched, uint64_t cycle, uint64_t period, uint8_t (*out)[8])
+{
+	memset(s, 0, sizeof(struct leds_t));
+	
+	s->sched = sched;
+	s->period = period;
+	s->cycle = cycle;
+	s->frame = cycle;
+	s->out = out;
+	
+	sched_add(sched, cycle - cycle % period + period, &_frame_event, s);
+}
+
+/* The segments lit on each digit from cycle onwards */
+void leds_set(struct leds_t *s, uint64_t cycle, const uint8_t *lit)
+{
+	_advance(s, cycle);
+	memcpy(s->lit, lit, LEDS_DIGITS);
+}
+
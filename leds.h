@@ -0,0 +1,49 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef _LEDS_H
+#define _LEDS_H
+
+#include <stdint.h>
+#include "sched.h"
+
+#define LEDS_DIGITS 2
+
+/* Multiplexed 7-segment display. The time each segment is lit is summed
+ * between changes, and at the end of each frame turned into a brightness
+ * relative to a full share of the multiplex cycle */
+struct leds_t {
+	struct sched_t *sched;
+	uint64_t period;
+	
+	/* Cycle of the last change and the start of the frame */
+	uint64_t cycle;
+	uint64_t frame;
+	
+	/* Segments lit now, and cycles lit so far this frame */
+	uint8_t lit[LEDS_DIGITS];
+	uint64_t on[LEDS_DIGITS][8];
+	
+	/* Brightness of each segment, 0-255, written each frame */
+	uint8_t (*out)[8];
+};
+
+extern void leds_init(struct leds_t *s, struct sched_t *sched, uint64_t cycle, uint64_t period, uint8_t (*out)[8]);
+extern void leds_set(struct leds_t *s, uint64_t cycle, const uint8_t *lit);
+
+#endif
+
@@ -0,0 +1,176 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include <stdio.h>
+#include <string.h>
+#include "lockstep.h"
+
+static void _state(struct lockstep_state_t *st, struct cpu_65c02_t *cpu)
+{
+	st->cycle = cpu->cycle;
+	st->pc = cpu->pc;
+	st->a = cpu->a;
+	st->x = cpu->x;
+	st->y = cpu->y;
+	st->sp = cpu->sp;
+	st->p = cpu_65c02_status(cpu);
+}
+
+static const char *_op(struct cpu_65c02_t *cpu, uint16_t pc)
+{
+	const uint8_t *p = cpu->mem->rpage[pc >> 8];
+	
+	/* Don't touch I/O just to disassemble it */
+	return(p ? cpu_65c02_mnemonic(p[pc & 0xFF]) : "");
+}
+
+static void _field(struct lockstep_t *s, const char *name, unsigned long a, unsigned long b, int hex)
+{
+	printf(hex ? "lockstep: %s: %-6s %10lX %10lX%s\n" : "lockstep: %s: %-6s %10lu %10lu%s\n",
+		s->name, name, a, b, a != b ? "  <--" : "");
+}
+
+static void _report(struct lockstep_t *s)
+{
+	struct lockstep_state_t a, b;
+	struct lockstep_state_t *t;
+	char name[SYMBOLS_TEXT];
+	uint64_t i;
+	int n;
+	
+	printf("lockstep: %s: %s and %s diverged after %lu %s\n",
+		s->name, s->ref_name, s->cpu_name, s->count, s->events ? "events" : "instructions");
+	
+	/* The last instructions or events that agreed, oldest first */
+	i = s->count >= LOCKSTEP_TRACE ? s->count - LOCKSTEP_TRACE + 1 : 0;
+	
+	for(; i <= s->count; i++)
+	{
+		t = &s->trace[i % LOCKSTEP_TRACE];
+		printf("lockstep: %s: %04X %-4s A:%02X X:%02X Y:%02X SP:%02X P:%02X %lu %s\n",
+			s->name, t->pc, _op(s->ref, t->pc), t->a, t->x, t->y, t->sp, t->p, t->cycle,
+			symbols_format(s->sym, t->pc, name));
+	}
+	
+	_state(&a, s->ref);
+	_state(&b, s->cpu);
+	
+	printf("lockstep: %s: %-6s %10s %10s\n", s->name, "", s->ref_name, s->cpu_name);
+	_field(s, "pc", a.pc, b.pc, 1);
+	_field(s, "a", a.a, b.a, 1);
+	_field(s, "x", a.x, b.x, 1);
+	_field(s, "y", a.y, b.y, 1);
+	_field(s, "sp", a.sp, b.sp, 1);
+	_field(s, "p", a.p, b.p, 1);
+	_field(s, "cycle", a.cycle, b.cycle, 0);
+	
+	if(s->events)
+	{
+		_field(s, "writes", s->ref->writes, s->cpu->writes, 0);
+		
+		for(n = 0; n < s->ram_len; n++)
+		{
+			if(s->ref_ram[n] != s->cpu_ram[n])
+			{
+				printf("lockstep: %s: ram    %04X=%02X    %04X=%02X  <--\n",
+					s->name, n, s->ref_ram[n], n, s->cpu_ram[n]);
+			}
+		}
+		
+		return;
+	}
+	
+	_field(s, "writes", s->ref_wlog.len, s->cpu_wlog.len, 0);
+	
+	n = s->ref_wlog.len > s->cpu_wlog.len ? s->ref_wlog.len : s->cpu_wlog.len;
+	
+	for(i = 0; i < n; i++)
+	{
+		char wa[16] = "-", wb[16] = "-";
+		
+		if(i < s->ref_wlog.len) sprintf(wa, "%04X=%02X", s->ref_wlog.addr[i], s->ref_wlog.v[i]);
+		if(i < s->cpu_wlog.len) sprintf(wb, "%04X=%02X", s->cpu_wlog.addr[i], s->cpu_wlog.v[i]);
+		
+		printf("lockstep: %s: write  %10s %10s%s\n",
+			s->name, wa, wb, strcmp(wa, wb) ? "  <--" : "");
+	}
+}
+
+void lockstep_init(struct lockstep_t *s, const char *name, struct cpu_65c02_t *ref, const char *ref_name, struct cpu_65c02_t *cpu, const char *cpu_name)
+{
+	memset(s, 0, sizeof(struct lockstep_t));
+	
+	s->name = name;
+	s->ref = ref;
+	s->cpu = cpu;
+	s->ref_name = ref_name;
+	s->cpu_name = cpu_name;
+	
+	ref->wlog = &s->ref_wlog;
+	cpu->wlog = &s->cpu_wlog;
+	
+	_state(&s->trace[0], ref);
+}
+
+void lockstep_events(struct lockstep_t *s, const uint8_t *ref_ram, const uint8_t *cpu_ram, int len)
+{
+	/* Too many writes between events to log */
+	s->ref->wlog = NULL;
+	s->cpu->wlog = NULL;
+	
+	s->events = 1;
+	s->ref_ram = ref_ram;
+	s->cpu_ram = cpu_ram;
+	s->ram_len = len;
+}
+
+int lockstep_check(struct lockstep_t *s)
+{
+	struct cpu_65c02_t *a = s->ref;
+	struct cpu_65c02_t *b = s->cpu;
+	
+	if(s->diverged)
+	{
+		return(-1);
+	}
+	
+	if(a->pc != b->pc ||
+	   a->a != b->a ||
+	   a->x != b->x ||
+	   a->y != b->y ||
+	   a->sp != b->sp ||
+	   a->cycle != b->cycle ||
+	   cpu_65c02_status(a) != cpu_65c02_status(b) ||
+	   s->ref_wlog.len != s->cpu_wlog.len ||
+	   memcmp(s->ref_wlog.addr, s->cpu_wlog.addr, sizeof(uint16_t) * s->ref_wlog.len) != 0 ||
+	   memcmp(s->ref_wlog.v, s->cpu_wlog.v, s->ref_wlog.len) != 0 ||
+	   (s->events && (a->writes != b->writes ||
+	   memcmp(s->ref_ram, s->cpu_ram, s->ram_len) != 0)))
+	{
+		_report(s);
+		s->diverged = 1;
+		return(-1);
+	}
+	
+	s->ref_wlog.len = 0;
+	s->cpu_wlog.len = 0;
+	
+	_state(&s->trace[++s->count % LOCKSTEP_TRACE], a);
+	
+	return(0);
+}
+
@@ -0,0 +1,73 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef _LOCKSTEP_H
+#define _LOCKSTEP_H
+
+#include <stdint.h>
+#include "cpu_65c02.h"
+#include "symbols.h"
+
+/* Number of instructions shown before a divergence */
+#define LOCKSTEP_TRACE 32
+
+struct lockstep_state_t {
+	uint64_t cycle;
+	uint16_t pc;
+	uint8_t a;
+	uint8_t x;
+	uint8_t y;
+	uint8_t sp;
+	uint8_t p;
+};
+
+struct lockstep_t {
+	const char *name;
+	
+	/* The reference CPU and the one checked against it, each in
+	 * its own copy of the machine */
+	struct cpu_65c02_t *ref;
+	struct cpu_65c02_t *cpu;
+	const char *ref_name;
+	const char *cpu_name;
+	
+	struct cpu_write_log_t ref_wlog;
+	struct cpu_write_log_t cpu_wlog;
+	
+	/* Ring of the reference state before each recent instruction */
+	struct lockstep_state_t trace[LOCKSTEP_TRACE];
+	uint64_t count;
+	
+	int diverged;
+	
+	/* Compared only at events, on the RAM rather than each write.
+	 * count is then the number of events */
+	int events;
+	const uint8_t *ref_ram;
+	const uint8_t *cpu_ram;
+	int ram_len;
+	
+	/* Optional symbols for the report */
+	const struct symbols_t *sym;
+};
+
+extern void lockstep_init(struct lockstep_t *s, const char *name, struct cpu_65c02_t *ref, const char *ref_name, struct cpu_65c02_t *cpu, const char *cpu_name);
+extern void lockstep_events(struct lockstep_t *s, const uint8_t *ref_ram, const uint8_t *cpu_ram, int len);
+extern int lockstep_check(struct lockstep_t *s);
+
+#endif
+
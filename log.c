@@ -0,0 +1,267 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Messages from the emulation thread are formatted into a ring of fixed
+ * size slots and written out by a background thread, so stdio never
+ * blocks the emulation. A message the same as the last in its category
+ * is only counted, and each category is limited to LOG_RATE messages a
+ * second. Anything dropped is reported. Before log_start() or after
+ * log_stop() messages are written directly */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "log.h"
+
+#define LOG_SLOTS 1024 /* Must be a power of two */
+#define LOG_TEXT  128
+#define LOG_RATE  1000
+
+uint8_t log_level[LOG_CATEGORIES] = {
+	[LOG_CPU]   = LOG_INFO,
+	[LOG_I2C]   = LOG_INFO,
+	[LOG_TIMER] = LOG_INFO,
+	[LOG_OSD]   = LOG_INFO,
+	[LOG_IO]    = LOG_INFO,
+};
+
+static const char *_names[LOG_CATEGORIES] = {
+	[LOG_CPU]   = "cpu",
+	[LOG_I2C]   = "i2c",
+	[LOG_TIMER] = "timer",
+	[LOG_OSD]   = "osd",
+	[LOG_IO]    = "io",
+};
+
+/* The ring, written by the emulation thread only and read by the
+ * writer thread only */
+static char _ring[LOG_SLOTS][LOG_TEXT];
+static atomic_uint _head;
+static atomic_uint _tail;
+static atomic_int _running;
+static pthread_t _thread;
+
+/* Per category state, emulation thread only except dropped */
+static char _last[LOG_CATEGORIES][LOG_TEXT];
+static unsigned int _repeats[LOG_CATEGORIES];
+static time_t _second[LOG_CATEGORIES];
+static unsigned int _count[LOG_CATEGORIES];
+static atomic_uint _dropped[LOG_CATEGORIES];
+
+static void _push(int category, const char *text)
+{
+	unsigned int head = atomic_load_explicit(&_head, memory_order_relaxed);
+	
+	if(!atomic_load_explicit(&_running, memory_order_relaxed))
+	{
+		fputs(text, stdout);
+		return;
+	}
+	
+	if(head - atomic_load_explicit(&_tail, memory_order_acquire) == LOG_SLOTS)
+	{
+		atomic_fetch_add_explicit(&_dropped[category], 1, memory_order_relaxed);
+		return;
+	}
+	
+	strcpy(_ring[head & (LOG_SLOTS - 1)], text);
+	atomic_store_explicit(&_head, head + 1, memory_order_release);
+}
+
+static void _flush_repeats(int category)
+{
+	char text[LOG_TEXT];
+	
+	if(_repeats[category])
+	{
+		snprintf(text, sizeof(text), "log: last %s message repeated %u times\n", _names[category], _repeats[category]);
+		_push(category, text);
+		_repeats[category] = 0;
+	}
+}
+
+void log_write(int category, const char *fmt, ...)
+{
+	char text[LOG_TEXT];
+	struct timespec ts;
+	va_list ap;
+	
+	va_start(ap, fmt);
+	vsnprintf(text, sizeof(text), fmt, ap);
+	va_end(ap);
+	
+	if(strcmp(text, _last[category]) == 0)
+	{
+		_repeats[category]++;
+		return;
+	}
+	
+	_flush_repeats(category);
+	strcpy(_last[category], text);
+	
+	/* A burst of LOG_RATE messages each second */
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+	
+	if(ts.tv_sec != _second[category])
+	{
+		_second[category] = ts.tv_sec;
+		_count[category] = 0;
+	}
+	
+	if(_count[category]++ >= LOG_RATE)
+	{
+		atomic_fetch_add_explicit(&_dropped[category], 1, memory_order_relaxed);
+		return;
+	}
+	
+	_push(category, text);
+}
+
+/* Set levels from a list like "i2c=off,io=debug" or "all=error" */
+int log_levels(const char *spec)
+{
+	static const char *levels[] = { "off", "error", "info", "debug" };
+	const char *p = spec;
+	const char *e;
+	size_t n;
+	int c, l;
+	
+	while(*p)
+	{
+		e = strchr(p, '=');
+		if(!e)
+		{
+			return(-1);
+		}
+		
+		n = e - p;
+		
+		for(l = 0; l < 4 && strncmp(e + 1, levels[l], strlen(levels[l])) != 0; l++);
+		if(l == 4)
+		{
+			return(-1);
+		}
+		
+		for(c = 0; c < LOG_CATEGORIES; c++)
+		{
+			if((n == 3 && strncmp(p, "all", 3) == 0) ||
+			   (n == strlen(_names[c]) && strncmp(p, _names[c], n) == 0))
+			{
+				log_level[c] = l;
+			}
+		}
+		
+		p = e + 1 + strlen(levels[l]);
+		
+		if(*p == ',')
+		{
+			p++;
+		}
+		else if(*p != '\0')
+		{
+			return(-1);
+		}
+	}
+	
+	return(0);
+}
+
+static int _drain(void)
+{
+	unsigned int tail = atomic_load_explicit(&_tail, memory_order_relaxed);
+	unsigned int head = atomic_load_explicit(&_head, memory_order_acquire);
+	static unsigned int reported[LOG_CATEGORIES];
+	unsigned int n;
+	int c;
+	
+	for(n = head - tail; tail != head; tail++)
+	{
+		fputs(_ring[tail & (LOG_SLOTS - 1)], stdout);
+		atomic_store_explicit(&_tail, tail + 1, memory_order_release);
+	}
+	
+	for(c = 0; c < LOG_CATEGORIES; c++)
+	{
+		unsigned int d = atomic_load_explicit(&_dropped[c], memory_order_relaxed);
+		
+		if(d != reported[c])
+		{
+			printf("log: %u %s messages dropped\n", d - reported[c], _names[c]);
+			reported[c] = d;
+			n++;
+		}
+	}
+	
+	if(n)
+	{
+		fflush(stdout);
+	}
+	
+	return(n);
+}
+
+static void *_writer(void *arg)
+{
+	while(atomic_load(&_running))
+	{
+		if(_drain() == 0)
+		{
+			usleep(10000);
+		}
+	}
+	
+	return(NULL);
+}
+
+/* Start writing messages from a background thread */
+int log_start(void)
+{
+	atomic_store(&_running, 1);
+	
+	if(pthread_create(&_thread, NULL, &_writer, NULL) != 0)
+	{
+		atomic_store(&_running, 0);
+		return(-1);
+	}
+	
+	return(0);
+}
+
+/* Write out everything pending and stop the thread */
+void log_stop(void)
+{
+	int c;
+	
+	for(c = 0; c < LOG_CATEGORIES; c++)
+	{
+		_flush_repeats(c);
+	}
+	
+	if(atomic_load(&_running))
+	{
+		atomic_store(&_running, 0);
+		pthread_join(_thread, NULL);
+		_drain();
+	}
+}
+
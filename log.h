@@ -0,0 +1,51 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef _LOG_H
+#define _LOG_H
+
+#include <stdint.h>
+
+/* Categories */
+enum {
+	LOG_CPU,
+	LOG_I2C,
+	LOG_TIMER,
+	LOG_OSD,
+	LOG_IO,
+	LOG_CATEGORIES
+};
+
+/* Levels, a message is shown if its category's level is at least this */
+#define LOG_OFF   0
+#define LOG_ERROR 1
+#define LOG_INFO  2
+#define LOG_DEBUG 3
+
+extern uint8_t log_level[LOG_CATEGORIES];
+
+/* A disabled message costs one compare and branch at the call site */
+#define log_printf(category, level, ...) \
+	do { if(__builtin_expect(log_level[category] >= (level), 0)) log_write(category, __VA_ARGS__); } while(0)
+
+extern void log_write(int category, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+extern int log_levels(const char *spec);
+extern int log_start(void);
+extern void log_stop(void);
+
+#endif
+
@@ -0,0 +1,567 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "machine.h"
+#include "hoststat.h"
+#include "rommap.h"
+#include "log.h"
+
+/* The scheduler runs on SRB1 CPU cycles */
+#define TIMER_START   MACHINE_BOOT_CYCLES /* SRB1 cycle of the first timer interrupt */
+#define TIMER_PERIOD  16000  /* 4ms */
+
+/* Saved state images, see machine_save() */
+#define STATE_MAGIC   "SRB1STAT"
+#define STATE_VERSION 3
+
+static uint8_t _srb1_memory_read(void *private, uint16_t addr)
+{
+	struct srb1_system_t *s = private;
+	
+	if(addr >= 0x8000)
+	{
+		return(s->rom[addr - 0x8000]);
+	}
+	
+	log_printf(LOG_IO, LOG_ERROR, "srb1: invalid read $%04X\n", addr);
+	
+	return(0xFF);
+}
+
+static void _srb1_memory_write(void *private, uint16_t addr, uint8_t v)
+{
+	struct srb1_system_t *s = private;
+	
+	/* Writing to ROM? */
+	s->ccu.core.faults |= CPU_FAULT_WRITE;
+	log_printf(LOG_IO, LOG_ERROR, "srb1: invalid write $%04X = $%02X\n", addr, v);
+}
+
+static int _srb1_memory_init(struct srb1_system_t *s)
+{
+	FILE *f;
+	
+	s->rom = malloc(0x8000);
+	if(!s->rom)
+	{
+		return(-1);
+	}
+	
+	/* Read the ROM */
+	f = fopen("firmware-srb1.bin", "rb");
+	fread(s->rom, 1, 0x8000, f);
+	fclose(f);
+	
+	/* Read the optional code map, see romscan */
+	s->map = rommap_load("firmware-srb1.map", 0x8000);
+	
+	/* And the optional symbols */
+	symbols_load(&s->sym, "firmware-srb1.sym");
+	
+	memset(&s->mem, 0, sizeof(struct cpu_memory_t));
+	s->mem.private = s;
+	s->mem.read = &_srb1_memory_read;
+	s->mem.write = &_srb1_memory_write;
+	
+	/* The ROM can be read directly */
+	cpu_memory_map(&s->mem, 0x8000, 0x8000, s->rom, NULL);
+	
+	return(0);
+}
+
+static uint8_t _acm_io_read(struct acm_system_t *s, uint16_t addr)
+{
+	s->io_reads[addr - 0x2000]++;
+	log_printf(LOG_IO, LOG_DEBUG, "acm: IO read: %04X\n", addr);
+	return(0xFF);
+}
+
+static void _acm_io_write(struct acm_system_t *s, uint16_t addr, uint8_t v)
+{
+	s->io_writes[addr - 0x2000]++;
+	
+	/* Writing to OSD */
+	if(addr >= 0x4000 && addr <= 0x4003)
+	{
+		log_printf(LOG_OSD, LOG_DEBUG, "acm: OSD write: %04X = %02X\n", addr, v);
+	}
+	else
+	{
+		log_printf(LOG_IO, LOG_DEBUG, "acm: IO write: %04X = %02X\n", addr, v);
+	}
+	
+	if(addr == 0x4000)
+	{
+		s->osd_ptr = (s->osd_ptr & 0xFF00) + v;
+	}
+	else if(addr == 0x4001)
+	{
+		s->osd_ptr = (s->osd_ptr & 0x00FF) + (v << 8);
+	}
+	else if(addr == 0x4002 && s->osd)
+	{
+		s->osd[s->osd_ptr++ & 0x1FF] = v;
+	}
+}
+
+static uint8_t _acm_memory_read(void *private, uint16_t addr)
+{
+	struct acm_system_t *s = private;
+	
+	if(addr < 0x2000)
+	{
+		return(s->ram[addr]);
+	}
+	else if(addr < 0x8000)
+	{
+		if(s->stats)
+		{
+			int64_t t = hoststat_now();
+			uint8_t v = _acm_io_read(s, addr);
+			hoststat_io(s->stats, hoststat_now() - t);
+			return(v);
+		}
+		
+		return(_acm_io_read(s, addr));
+	}
+	
+	return(s->rom[addr - 0x8000]);
+}
+
+static void _acm_memory_write(void *private, uint16_t addr, uint8_t v)
+{
+	struct acm_system_t *s = private;
+	
+	if(addr < 0x2000)
+	{
+		s->ram[addr] = v;
+	}
+	else if(addr < 0x8000)
+	{
+		if(s->stats)
+		{
+			int64_t t = hoststat_now();
+			_acm_io_write(s, addr, v);
+			hoststat_io(s->stats, hoststat_now() - t);
+		}
+		else
+		{
+			_acm_io_write(s, addr, v);
+		}
+	}
+	else
+	{
+		/* Writing to ROM? */
+		s->cpu.faults |= CPU_FAULT_WRITE;
+		//printf("acm: invalid write $%04X = $%02X\n", addr, v);
+	}
+}
+
+static int _acm_memory_init(struct acm_system_t *s)
+{
+	FILE *f;
+	
+	s->rom = malloc(0x8000);
+	if(!s->rom)
+	{
+		return(-1);
+	}
+	
+	/* Read the ROM */
+	f = fopen("firmware-acm.bin", "rb");
+	fread(s->rom, 1, 0x8000, f);
+	fclose(f);
+	
+	/* Read the optional code map, see romscan */
+	s->map = rommap_load("firmware-acm.map", 0x8000);
+	
+	/* And the optional symbols */
+	symbols_load(&s->sym, "firmware-acm.sym");
+	
+	/* Allocate the RAM, cleared so every start without an image is alike */
+	s->ram = calloc(0x2000, 1);
+	if(!s->ram)
+	{
+		return(-1);
+	}
+	
+	/* Read the optional RAM image */
+	f = fopen("bbram-acm.bin", "rb");
+	if(f)
+	{
+		fread(s->ram, 1, 0x2000, f);
+		fclose(f);
+	}
+	
+	/* Fill the OSD with 'A' for test */
+	s->osd_ptr = 0;
+	s->stats = NULL;
+	
+	memset(&s->mem, 0, sizeof(struct cpu_memory_t));
+	s->mem.private = s;
+	s->mem.read = &_acm_memory_read;
+	s->mem.write = &_acm_memory_write;
+	
+	/* RAM and ROM can be accessed directly, only I/O needs the handlers */
+	cpu_memory_map(&s->mem, 0x0000, 0x2000, s->ram, s->ram);
+	cpu_memory_map(&s->mem, 0x8000, 0x8000, s->rom, NULL);
+	
+	return(0);
+}
+
+static void _timer1_event(void *private, uint64_t cycle)
+{
+	struct srb1_system_t *s = private;
+	
+	/* Trigger a Timer1 interrupt */
+	cpu_ccu3000_irq_custom(&s->ccu, _srb1_memory_read(s, 0xFFF6) | (_srb1_memory_read(s, 0xFFF7) << 8), 0);
+	sched_add(s->sched, cycle + TIMER_PERIOD, &_timer1_event, s);
+}
+
+static void _timer2_event(void *private, uint64_t cycle)
+{
+	struct srb1_system_t *s = private;
+	
+	/* Trigger a Timer2 interrupt */
+	cpu_ccu3000_irq_custom(&s->ccu, _srb1_memory_read(s, 0xFFF4) | (_srb1_memory_read(s, 0xFFF5) << 8), 0);
+	sched_add(s->sched, cycle + TIMER_PERIOD, &_timer2_event, s);
+}
+
+static void _watchdog_event(void *private, uint64_t cycle)
+{
+	struct srb1_system_t *s = private;
+	uint64_t resets = s->ccu.wd_resets;
+	
+	sched_add(s->sched, cpu_ccu3000_watchdog(&s->ccu, cycle), &_watchdog_event, s);
+	
+	/* The timers start again as they do at power on */
+	if(s->ccu.wd_resets != resets)
+	{
+		sched_remove(s->sched, &_timer1_event, s);
+		sched_remove(s->sched, &_timer2_event, s);
+		sched_add(s->sched, cycle + TIMER_START, &_timer1_event, s);
+		sched_add(s->sched, cycle + TIMER_START + TIMER_PERIOD / 2, &_timer2_event, s);
+	}
+}
+
+int machine_init(struct machine_t *s, const struct cpu_65c02_engine_t *engine)
+{
+	sched_init(&s->sched);
+	
+	/* Configure SRB1 system (4 MHz clock) */
+	if(_srb1_memory_init(&s->srb1) != 0)
+	{
+		return(-1);
+	}
+	
+	cpu_ccu3000_init(&s->srb1.ccu, 4000000, 1, &s->srb1.mem);
+	s->srb1.ccu.p5_data_in = 0xFF;
+	s->srb1.ccu.p6_data_in = 0xFF;
+	s->srb1.ccu.p8_data_in = 0xFF;
+	s->srb1.ccu.core.verbose = 0;
+	s->srb1.sched = &s->sched;
+	
+	/* Configure ACM system (8 MHz clock - it's not) */
+	if(_acm_memory_init(&s->acm) != 0)
+	{
+		return(-1);
+	}
+	
+	cpu_65c02_init(&s->acm.cpu, 8000000, 1, &s->acm.mem);
+	s->acm.osd = NULL;
+	s->acm.cpu.verbose = 0;
+	
+	/* Both memory maps are complete, let the engine adjust them */
+	s->engine = engine ? engine : &cpu_65c02_engines[0];
+	
+	if(s->engine->setup)
+	{
+		s->engine->setup(&s->srb1.ccu.core);
+		s->engine->setup(&s->acm.cpu);
+	}
+	
+	/* Timer interrupts, Timer2 half a period behind Timer1 */
+	sched_add(&s->sched, TIMER_START, &_timer1_event, &s->srb1);
+	sched_add(&s->sched, TIMER_START + TIMER_PERIOD / 2, &_timer2_event, &s->srb1);
+	
+	/* Watchdog, checked once a timeout until it's armed */
+	sched_add(&s->sched, CCU3000_WATCHDOG_CYCLES, &_watchdog_event, &s->srb1);
+	
+	return(0);
+}
+
+/* A save, load or size pass over the machine state */
+struct _stream_t {
+	FILE *f;
+	int load;
+	size_t size;
+	int err;
+};
+
+static void _field(struct _stream_t *st, void *p, size_t n)
+{
+	if(st->err)
+	{
+		return;
+	}
+	
+	st->size += n;
+	
+	if(st->f && (st->load ? fread(p, 1, n, st->f) : fwrite(p, 1, n, st->f)) != n)
+	{
+		st->err = 1;
+	}
+}
+
+#define _FIELD(st, v) _field(st, &(v), sizeof(v))
+
+static void _cpu_state(struct _stream_t *st, struct cpu_65c02_t *cpu)
+{
+	_FIELD(st, cpu->cycle);
+	_FIELD(st, cpu->pc);
+	_FIELD(st, cpu->a);
+	_FIELD(st, cpu->x);
+	_FIELD(st, cpu->y);
+	_FIELD(st, cpu->sp);
+	_FIELD(st, cpu->nr);
+	_FIELD(st, cpu->v);
+	_FIELD(st, cpu->d);
+	_FIELD(st, cpu->i);
+	_FIELD(st, cpu->zr);
+	_FIELD(st, cpu->c);
+	_FIELD(st, cpu->depth);
+	_FIELD(st, cpu->wait);
+	_FIELD(st, cpu->writes);
+	_FIELD(st, cpu->bus_cycle);
+	
+	/* Not in the size pass, which has no file and leaves the CPU alone */
+	if(st->load && st->f)
+	{
+		/* Idle loops are found again from scratch */
+		cpu->idle = 0;
+		cpu->idle_pc = 0;
+		cpu->idle_writes = 0;
+		cpu->idle_volatile_reads = cpu->volatile_reads;
+		cpu->idle_cycle = cpu->cycle;
+	}
+}
+
+static void _event_state(struct _stream_t *st, struct sched_t *sched, sched_callback_t callback, void *private)
+{
+	uint64_t cycle = UINT64_MAX;
+	int i;
+	
+	for(i = 0; i < sched->count; i++)
+	{
+		if(sched->event[i].callback == callback && sched->event[i].private == private)
+		{
+			cycle = sched->event[i].cycle;
+		}
+	}
+	
+	_FIELD(st, cycle);
+	
+	if(st->load && st->f && !st->err)
+	{
+		sched_remove(sched, callback, private);
+		
+		if(cycle != UINT64_MAX)
+		{
+			sched_add(sched, cycle, callback, private);
+		}
+	}
+}
+
+static void _state(struct _stream_t *st, struct machine_t *s)
+{
+	struct cpu_ccu3000_t *ccu = &s->srb1.ccu;
+	uint8_t osd[512] = { 0 };
+	
+	/* SRB1 */
+	_cpu_state(st, &ccu->core);
+	_field(st, ccu->ram, 0x0640);
+	_FIELD(st, ccu->irq_enabled);
+	_FIELD(st, ccu->timer);
+	_FIELD(st, ccu->p5_ddr);
+	_FIELD(st, ccu->p5_data);
+	_FIELD(st, ccu->p5_data_in);
+	_FIELD(st, ccu->p6_ddr);
+	_FIELD(st, ccu->p6_data);
+	_FIELD(st, ccu->p6_data_in);
+	_FIELD(st, ccu->p7_ddr);
+	_FIELD(st, ccu->p7_data);
+	_FIELD(st, ccu->p7_data_in);
+	_FIELD(st, ccu->p8_ddr);
+	_FIELD(st, ccu->p8_data);
+	_FIELD(st, ccu->p8_data_in);
+	_FIELD(st, ccu->ir_in);
+	_FIELD(st, ccu->i2c_pv);
+	_FIELD(st, ccu->i2c_sr);
+	_FIELD(st, ccu->i2c_b);
+	_FIELD(st, ccu->i2c_start);
+	_FIELD(st, ccu->i2c_nack);
+	_FIELD(st, ccu->reset_cause);
+	_FIELD(st, ccu->wd_armed);
+	_FIELD(st, ccu->wd_kick);
+	_FIELD(st, ccu->wd_near_misses);
+	_FIELD(st, ccu->wd_resets);
+	
+	/* ACM, including the OSD it only writes at boot */
+	_cpu_state(st, &s->acm.cpu);
+	_field(st, s->acm.ram, 0x2000);
+	_FIELD(st, s->acm.osd_ptr);
+	_field(st, s->acm.osd ? s->acm.osd : osd, sizeof(osd));
+	
+	/* Pending events */
+	_event_state(st, &s->sched, &_timer1_event, &s->srb1);
+	_event_state(st, &s->sched, &_timer2_event, &s->srb1);
+	_event_state(st, &s->sched, &_watchdog_event, &s->srb1);
+}
+
+/* FNV-1a hash of everything the machine starts from: both ROMs, the
+ * ACM RAM as loaded from the BBRAM image, the core that runs them and
+ * the bus timing. Only meaningful before the machine has run */
+uint64_t machine_hash(struct machine_t *s)
+{
+	const uint8_t *p[3] = { s->srb1.rom, s->acm.rom, s->acm.ram };
+	const uint32_t n[3] = { 0x8000, 0x8000, 0x2000 };
+	uint64_t h = 0xCBF29CE484222325ULL;
+	const char *name;
+	uint32_t i, j;
+	
+	for(i = 0; i < 3; i++)
+	{
+		for(j = 0; j < n[i]; j++)
+		{
+			h = (h ^ p[i][j]) * 0x100000001B3ULL;
+		}
+	}
+	
+	for(name = s->engine->name; *name; name++)
+	{
+		h = (h ^ (uint8_t) *name) * 0x100000001B3ULL;
+	}
+	
+	h = (h ^ s->srb1.ccu.core.bus_timing) * 0x100000001B3ULL;
+	
+	return((h ^ STATE_VERSION) * 0x100000001B3ULL);
+}
+
+/* Write the state of both systems and the scheduler to an image, tagged
+ * with the machine_hash() taken at startup */
+int machine_save(struct machine_t *s, const char *path, uint64_t hash)
+{
+	struct _stream_t st = { NULL, 0, 0, 0 };
+	char tmp[1024];
+	char magic[8];
+	uint32_t version = STATE_VERSION;
+	
+	/* Write to a temporary file first so an image is never partial */
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	
+	st.f = fopen(tmp, "wb");
+	if(!st.f)
+	{
+		perror(tmp);
+		return(-1);
+	}
+	
+	memcpy(magic, STATE_MAGIC, 8);
+	_field(&st, magic, 8);
+	_FIELD(&st, version);
+	_FIELD(&st, hash);
+	_state(&st, s);
+	
+	if(fclose(st.f) != 0 || st.err || rename(tmp, path) != 0)
+	{
+		fprintf(stderr, "%s: failed to write the state image\n", path);
+		remove(tmp);
+		return(-1);
+	}
+	
+	return(0);
+}
+
+/* Restore an image written by machine_save(). Returns -1 without
+ * touching the machine if the image is missing or its hash, version or
+ * size don't match */
+int machine_load(struct machine_t *s, const char *path, uint64_t hash)
+{
+	struct _stream_t st = { NULL, 1, 0, 0 };
+	char magic[8];
+	uint32_t version;
+	uint64_t h;
+	long len;
+	
+	/* The size an image should be */
+	_state(&st, s);
+	len = st.size + 8 + sizeof(version) + sizeof(h);
+	
+	st.f = fopen(path, "rb");
+	if(!st.f)
+	{
+		return(-1);
+	}
+	
+	st.size = 0;
+	_field(&st, magic, 8);
+	_FIELD(&st, version);
+	_FIELD(&st, h);
+	
+	if(st.err || memcmp(magic, STATE_MAGIC, 8) != 0 || version != STATE_VERSION || h != hash ||
+	   fseek(st.f, 0, SEEK_END) != 0 || ftell(st.f) != len)
+	{
+		fprintf(stderr, "%s: not a state image for this machine, ignored\n", path);
+		fclose(st.f);
+		return(-1);
+	}
+	
+	fseek(st.f, st.size, SEEK_SET);
+	_state(&st, s);
+	fclose(st.f);
+	
+	return(st.err ? -1 : 0);
+}
+
+/* The I/O accesses of both systems so far. Only the ACM OSD writes are
+ * modelled, everything else in its window is marked '*' */
+void machine_io_dump(struct machine_t *s)
+{
+	char name[SYMBOLS_TEXT];
+	uint16_t addr;
+	int i;
+	
+	cpu_ccu3000_io_dump(&s->srb1.ccu);
+	
+	for(i = 0; i < 0x6000; i++)
+	{
+		if(s->acm.io_reads[i] || s->acm.io_writes[i])
+		{
+			addr = 0x2000 + i;
+			symbols_format(&s->acm.sym, addr, name);
+			
+			printf("acm: io: $%04X %10lu reads%c %10lu writes%c  %s\n", addr,
+				s->acm.io_reads[i], s->acm.io_reads[i] ? '*' : ' ',
+				s->acm.io_writes[i], s->acm.io_writes[i] && (addr < 0x4000 || addr > 0x4002) ? '*' : ' ',
+				name);
+		}
+	}
+}
+
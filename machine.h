@@ -0,0 +1,75 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef _MACHINE_H
+#define _MACHINE_H
+
+#include <stdint.h>
+#include "cpu_65c02.h"
+#include "cpu_ccu3000.h"
+#include "sched.h"
+#include "symbols.h"
+
+struct hoststat_t;
+
+struct srb1_system_t {
+	struct cpu_memory_t mem;
+	struct cpu_ccu3000_t ccu;
+	uint8_t *rom;
+	uint8_t *map;
+	struct symbols_t sym;
+	struct sched_t *sched;
+};
+
+struct acm_system_t {
+	struct cpu_65c02_t cpu;
+	struct cpu_memory_t mem;
+	uint8_t *ram;
+	uint8_t *rom;
+	uint8_t *map;
+	struct symbols_t sym;
+	uint8_t *osd;
+	uint16_t osd_ptr;
+	struct hoststat_t *stats;
+	
+	/* Accesses to each address in the I/O window at $2000-$7FFF */
+	uint64_t io_reads[0x6000];
+	uint64_t io_writes[0x6000];
+};
+
+/* SRB1 cycle the boot is complete by, just before the first timer
+ * interrupt. State images for the startup cache are taken here */
+#define MACHINE_BOOT_CYCLES 794930
+
+/* The SRB1 and ACM together, with the scheduler that drives them */
+struct machine_t {
+	struct srb1_system_t srb1;
+	struct acm_system_t acm;
+	struct sched_t sched;
+	
+	/* The core both CPUs run on */
+	const struct cpu_65c02_engine_t *engine;
+};
+
+extern int machine_init(struct machine_t *s, const struct cpu_65c02_engine_t *engine);
+extern uint64_t machine_hash(struct machine_t *s);
+extern int machine_save(struct machine_t *s, const char *path, uint64_t hash);
+extern int machine_load(struct machine_t *s, const char *path, uint64_t hash);
+extern void machine_io_dump(struct machine_t *s);
+
+#endif
+
@@ -16,256 +16,686 @@
 /* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
 #include <SDL2/SDL.h>
 #include "cpu_65c02.h"
 #include "cpu_ccu3000.h"
+#include "sched.h"
+#include "machine.h"
+#include "lockstep.h"
+#include "watch.h"
+#include "gdbstub.h"
+#include "monitor.h"
+#include "leds.h"
+#include "journal.h"
+#include "hle.h"
+#include "log.h"
+#include "pace.h"
+#include "profile.h"
+#include "hoststat.h"
 #include "ui.h"
 
-struct _srb1_system_t {
-	struct cpu_memory_t mem;
-	struct cpu_ccu3000_t ccu;
-	uint8_t *rom;
-};
+/* The scheduler runs on SRB1 CPU cycles */
+#define SLICE_CYCLES  4000   /* 1ms, the longest run between input updates */
+#define FRAME_CYCLES  160000 /* 40ms, the LED display frame */
 
-struct _acm_system_t {
-	struct cpu_65c02_t cpu;
-	struct cpu_memory_t mem;
-	uint8_t *ram;
-	uint8_t *rom;
-	uint8_t *osd;
-	uint16_t osd_ptr;
-};
-
-static uint8_t _srb1_memory_read(void *private, uint16_t addr)
+static void _update_leds(void *private, struct cpu_ccu3000_t *ccu, int port, uint64_t cycle)
 {
-	struct _srb1_system_t *s = private;
+	struct leds_t *leds = private;
+	uint8_t seg, sel, lit[LEDS_DIGITS];
 	
-	if(addr >= 0x8000)
+	/* Port 6 drives the segments and port 8 selects the digit */
+	if(port != 6 && port != 8)
 	{
-		return(s->rom[addr - 0x8000]);
+		return;
 	}
 	
-	printf("srb1: invalid read $%04X\n", addr);
+	/* The LEDs are illuminated if pin is output 1, or input */
+	seg = ~ccu->p6_data | ccu->p6_ddr;
+	sel = ~ccu->p8_data | ccu->p8_ddr;
+	
+	lit[0] = sel & (1 << 3) ? seg : 0;
+	lit[1] = sel & (1 << 2) ? seg : 0;
 	
-	return(0xFF);
+	leds_set(leds, cycle, lit);
 }
 
-static void _srb1_memory_write(void *private, uint16_t addr, uint8_t v)
+static void _watch_hit(struct watch_t *srb1, struct watch_t *acm, struct sdl_ui *ui)
 {
-	/* Writing to ROM? */
-	printf("srb1: invalid write $%04X = $%02X\n", addr, v);
+	/* Stop both machines here until the pause key is pressed */
+	watch_dump(srb1);
+	watch_dump(acm);
+	printf("watch: paused, press 'p' to continue\n");
+	
+	ui->paused = 1;
 }
 
-static int _srb1_memory_init(struct _srb1_system_t *s)
+static int _watch_option(struct watch_t *srb1, struct watch_t *acm, int type, const char *arg)
 {
-	FILE *f;
+	struct watch_t *w;
+	const char *p;
+	char *e;
+	long start, end;
+	
+	/* <cpu>:<addr>[-<end>][:r|w|rw], addresses in hex */
+	if(strncmp(arg, "srb1:", 5) == 0) w = srb1;
+	else if(strncmp(arg, "acm:", 4) == 0) w = acm;
+	else return(-1);
+	
+	p = strchr(arg, ':') + 1;
+	if(*p == '$') p++;
+	
+	start = end = strtol(p, &e, 16);
+	if(e == p) return(-1);
 	
-	s->rom = malloc(0x8000);
-	if(!s->rom)
+	if(*e == '-')
 	{
-		return(-1);
+		p = e + 1;
+		if(*p == '$') p++;
+		end = strtol(p, &e, 16);
 	}
 	
-	/* Read the ROM */
-	f = fopen("firmware-srb1.bin", "rb");
-	fread(s->rom, 1, 0x8000, f);
-	fclose(f);
+	if(*e == ':' && type != WATCH_EXEC)
+	{
+		type = 0;
+		if(strchr(e, 'r')) type |= WATCH_READ;
+		if(strchr(e, 'w')) type |= WATCH_WRITE;
+	}
+	else if(*e != '\0')
+	{
+		return(-1);
+	}
 	
-	s->mem.private = s;
-	s->mem.read = &_srb1_memory_read;
-	s->mem.write = &_srb1_memory_write;
+	if(start < 0 || end > 0xFFFF || type == 0)
+	{
+		return(-1);
+	}
 	
-	return(0);
+	return(watch_add(w, type, start, end));
 }
 
-static uint8_t _acm_memory_read(void *private, uint16_t addr)
+static void _usage(const char *name)
 {
-	struct _acm_system_t *s = private;
+	const struct cpu_65c02_engine_t *e;
+	const struct hle_hook_t *h;
 	
-	if(addr < 0x2000)
+	fprintf(stderr, "Usage: %s [-s speed] [-p profile] [-S stats] [-B] [-L engine]\n"
+		"          [-b cpu:addr] [-w cpu:addr[-end][:r|w|rw]] [-g port|path] [-m] [-C dir]\n"
+		"          [-r journal | -R journal] [-l category=level,...] [-i] [-H hooks]\n", name);
+	fprintf(stderr, "\nLog categories are cpu, i2c, timer, osd, io or all, and levels off,\n"
+		"error, info or debug (default info)\n");
+	fprintf(stderr, "\nEngines for -L, checked in lockstep against the normal core. fast and bus\n"
+		"share its interpreter and differ only in memory access:\n\n");
+	
+	for(e = cpu_65c02_engines; e->name; e++)
 	{
-		return(s->ram[addr]);
+		fprintf(stderr, "  %-8s %s\n", e->name, e->description);
 	}
-	else if(addr < 0x8000)
+	
+	fprintf(stderr, "\nACM routines for -H, as name[:check],... or all[:check]:\n\n");
+	
+	for(h = hle_hooks; h->name; h++)
 	{
-		//printf("acm: IO read: %04X\n", addr);
-		return(0xFF);
+		fprintf(stderr, "  %-8s %s\n", h->name, h->description);
 	}
-	
-	return(s->rom[addr - 0x8000]);
 }
 
-static void _acm_memory_write(void *private, uint16_t addr, uint8_t v)
+int main(int argc, char *argv[])
 {
-	struct _acm_system_t *s = private;
+	struct machine_t m;
+	struct machine_t shadow;
+	struct lockstep_t ls_srb1;
+	struct lockstep_t ls_acm;
+	struct watch_t w_srb1;
+	struct watch_t w_acm;
+	struct gdbstub_t gdb;
+	const char *gdb_addr = NULL;
+	struct monitor_t mon;
+	int monitor = 0;
+	const struct cpu_65c02_engine_t *lockstep = NULL;
+	struct sdl_ui ui;
+	struct leds_t leds;
+	struct pace_t pace;
+	struct journal_t journal;
+	const char *record = NULL;
+	const char *replay = NULL;
+	struct hle_t hle;
+	const char *hooks = NULL;
+	uint64_t next;
+	struct hoststat_t stats;
+	int64_t ns[HOSTSTAT_MAX];
+	int64_t t;
+	uint8_t buttons;
+	uint8_t pressed;
+	const char *profile = NULL;
+	const char *stats_name = NULL;
+	const char *cache = NULL;
+	char state[1024];
+	uint64_t hash;
+	int save = 0;
+	int speed = -1;
+	int bus_timing = 0;
+	int io_counts = 0;
+	int stop = 0;
+	int paused = 0;
+	int c;
 	
-	if(addr < 0x2000)
+	watch_init(&w_srb1, "srb1");
+	watch_init(&w_acm, "acm");
+	
+	while((c = getopt(argc, argv, "s:p:S:L:Bb:w:g:mC:r:R:l:iH:")) != -1)
 	{
-		s->ram[addr] = v;
+		switch(c)
+		{
+		case 's': speed = atoi(optarg); break;
+		case 'p': profile = optarg; break;
+		case 'S': stats_name = optarg; break;
+		case 'B': bus_timing = 1; break;
+		case 'g': gdb_addr = optarg; break;
+		case 'm': monitor = 1; break;
+		case 'C': cache = optarg; break;
+		case 'r': record = optarg; break;
+		case 'R': replay = optarg; break;
+		case 'i': io_counts = 1; break;
+		case 'H': hooks = optarg; break;
+		case 'l':
+			if(log_levels(optarg) != 0)
+			{
+				fprintf(stderr, "Bad log levels '%s'\n", optarg);
+				_usage(argv[0]);
+				return(-1);
+			}
+			break;
+		case 'b':
+		case 'w':
+			if(_watch_option(&w_srb1, &w_acm, c == 'b' ? WATCH_EXEC : WATCH_WRITE, optarg) != 0)
+			{
+				fprintf(stderr, "Bad watch '%s'\n", optarg);
+				_usage(argv[0]);
+				return(-1);
+			}
+			break;
+		case 'L':
+			lockstep = cpu_65c02_engine(optarg);
+			if(!lockstep)
+			{
+				fprintf(stderr, "Unknown engine '%s'\n", optarg);
+				_usage(argv[0]);
+				return(-1);
+			}
+			break;
+		default:
+			_usage(argv[0]);
+			return(-1);
+		}
 	}
-	else if(addr < 0x8000)
+	
+	if((gdb_addr || monitor) && lockstep)
 	{
-		//printf("acm: IO write: %04X = %02X\n", addr, v);
-		
-		/* Writing to OSD */
-		if(addr >= 0x4000 && addr <= 0x4003 && s->cpu.verbose)
+		/* Stepping from the debugger would leave the copy behind */
+		fprintf(stderr, "The debugger and lockstep mode can't be used together\n");
+		return(-1);
+	}
+	
+	if(record && (replay || gdb_addr || monitor))
+	{
+		/* Anything that can change the machine would be lost */
+		fprintf(stderr, "Recording can't be used with replay, the debugger or the monitor\n");
+		return(-1);
+	}
+	
+	/* Replay as fast as possible unless asked otherwise */
+	if(speed < 0)
+	{
+		speed = replay ? 0 : 1;
+	}
+	
+	if(cache && (profile || gdb_addr || monitor || w_srb1.count || w_acm.count))
+	{
+		/* These all want to see the boot */
+		fprintf(stderr, "The startup cache is off while profiling, debugging or watching\n");
+		cache = NULL;
+	}
+	
+	if(hooks && (lockstep || gdb_addr || monitor || w_acm.count))
+	{
+		/* These all follow the ACM an instruction at a time */
+		fprintf(stderr, "High-level emulation is off in lockstep, debugging or watching the ACM\n");
+		hooks = NULL;
+	}
+	
+	/* Peripheral messages are written from a thread of their own */
+	log_start();
+	
+	if(machine_init(&m, NULL) != 0)
+	{
+		fprintf(stderr, "Failed to initialise the machine\n");
+		log_stop();
+		return(-1);
+	}
+	
+	m.srb1.ccu.core.bus_timing = bus_timing;
+	m.acm.cpu.bus_timing = bus_timing;
+	hash = machine_hash(&m);
+	
+	/* Known firmware routines can be run natively */
+	if(hle_init(&hle, &m.acm, hooks) != 0)
+	{
+		fprintf(stderr, "Bad hooks '%s'\n", hooks);
+		_usage(argv[0]);
+		log_stop();
+		return(-1);
+	}
+	
+	watch_attach(&w_srb1, &m.srb1.ccu.core);
+	watch_attach(&w_acm, &m.acm.cpu);
+	w_srb1.sym = &m.srb1.sym;
+	w_acm.sym = &m.acm.sym;
+	
+	/* A second copy of the machine, run on the engine under test */
+	if(lockstep)
+	{
+		if(machine_init(&shadow, lockstep) != 0)
 		{
-			printf("acm: OSD write: %04X = %02X\n", addr, v);
+			fprintf(stderr, "Failed to initialise the machine\n");
+			log_stop();
+			return(-1);
 		}
 		
-		if(addr == 0x4000)
+		shadow.srb1.ccu.core.bus_timing = bus_timing;
+		shadow.acm.cpu.bus_timing = bus_timing;
+		
+		lockstep_init(&ls_srb1, "srb1", &m.srb1.ccu.core, m.engine->name, &shadow.srb1.ccu.core, lockstep->name);
+		lockstep_init(&ls_acm, "acm", &m.acm.cpu, m.engine->name, &shadow.acm.cpu, lockstep->name);
+		ls_srb1.sym = &m.srb1.sym;
+		ls_acm.sym = &m.acm.sym;
+		
+		if(lockstep->no_idle)
 		{
-			s->osd_ptr = (s->osd_ptr & 0xFF00) + v;
+			lockstep_events(&ls_srb1, m.srb1.ccu.ram, shadow.srb1.ccu.ram, 0x0640);
+			lockstep_events(&ls_acm, m.acm.ram, shadow.acm.ram, 0x2000);
 		}
-		else if(addr == 0x4001)
+	}
+	
+	ui_start(&ui);
+	ui.speed = speed;
+	m.acm.osd = ui.osd;
+	
+	/* Skip the boot if it has been run before with the same ROMs and
+	 * BBRAM, or save the state after it this time */
+	if(cache)
+	{
+		if(mkdir(cache, 0777) != 0 && errno != EEXIST)
 		{
-			s->osd_ptr = (s->osd_ptr & 0x00FF) + (v << 8);
+			perror(cache);
+			ui_end(&ui);
+			log_stop();
+			return(-1);
 		}
-		else if(addr == 0x4002 && s->osd)
+		
+		snprintf(state, sizeof(state), "%s/boot-%016lx.state", cache, hash);
+		
+		if(machine_load(&m, state, hash) == 0)
 		{
-			s->osd[s->osd_ptr++ & 0x1FF] = v;
+			/* Lockstep starts both copies from the same image */
+			if(lockstep) machine_load(&shadow, state, hash);
+		}
+		else
+		{
+			save = 1;
 		}
 	}
-	else
+	
+	/* The LEDs follow the port writes */
+	leds_init(&leds, &m.sched, m.srb1.ccu.core.cycle, FRAME_CYCLES, ui.leds);
+	m.srb1.ccu.port_write = &_update_leds;
+	m.srb1.ccu.port_private = &leds;
+	
+	/* No buttons pressed (pressed = 0) */
+	buttons = 0;
+	cpu_ccu3000_port_input(&m.srb1.ccu, 6, 0xFF);
+	if(lockstep) cpu_ccu3000_port_input(&shadow.srb1.ccu, 6, 0xFF);
+	
+	/* Every input from outside goes through the journal */
+	if((record && journal_record(&journal, record, hash, m.srb1.ccu.core.cycle) != 0) ||
+	   (replay && journal_replay(&journal, replay, hash, m.srb1.ccu.core.cycle) != 0))
 	{
-		/* Writing to ROM? */
-		//printf("acm: invalid write $%04X = $%02X\n", addr, v);
+		ui_end(&ui);
+		log_stop();
+		return(-1);
 	}
-}
-
-static int _acm_memory_init(struct _acm_system_t *s)
-{
-	FILE *f;
 	
-	s->rom = malloc(0x8000);
-	if(!s->rom)
+	if(gdb_addr && gdbstub_init(&gdb, gdb_addr, &m, &w_srb1, &w_acm, &ui.paused, &stop) != 0)
 	{
+		ui_end(&ui);
+		log_stop();
 		return(-1);
 	}
 	
-	/* Read the ROM */
-	f = fopen("firmware-acm.bin", "rb");
-	fread(s->rom, 1, 0x8000, f);
-	fclose(f);
-	
-	/* Allocate the RAM */
-	s->ram = malloc(0x2000);
-	if(!s->ram)
+	if(monitor && monitor_init(&mon, &m, &w_srb1, &w_acm, &ui.paused, &stop) != 0)
 	{
+		ui_end(&ui);
+		log_stop();
 		return(-1);
 	}
 	
-	/* Read the optional RAM image */
-	f = fopen("bbram-acm.bin", "rb");
-	if(f)
+	if(profile)
 	{
-		fread(s->ram, 1, 0x2000, f);
-		fclose(f);
+		m.srb1.ccu.core.prof = profile_init("srb1");
+		m.acm.cpu.prof = profile_init("acm");
+		
+		if(!m.srb1.ccu.core.prof || !m.acm.cpu.prof)
+		{
+			fprintf(stderr, "Failed to allocate the profiles\n");
+			if(m.srb1.ccu.core.prof) profile_free(m.srb1.ccu.core.prof);
+			if(m.acm.cpu.prof) profile_free(m.acm.cpu.prof);
+			ui_end(&ui);
+			log_stop();
+			return(-1);
+		}
+		
+		m.srb1.ccu.core.prof->sym = &m.srb1.sym;
+		m.acm.cpu.prof->sym = &m.acm.sym;
 	}
 	
-	/* Fill the OSD with 'A' for test */
-	s->osd_ptr = 0;
-	
-	s->mem.private = s;
-	s->mem.read = &_acm_memory_read;
-	s->mem.write = &_acm_memory_write;
-	
-	return(0);
-}
-
-int main(int argc, char *argv[])
-{
-	struct _srb1_system_t srb1;
-	struct _acm_system_t acm;
-	struct sdl_ui ui;
-	int counter = 0;
+	if(stats_name)
+	{
+		if(hoststat_init(&stats, stats_name) != 0)
+		{
+			fprintf(stderr, "Failed to publish the host statistics\n");
+			ui_end(&ui);
+			log_stop();
+			return(-1);
+		}
+		
+		m.srb1.ccu.stats = &stats;
+		m.acm.stats = &stats;
+	}
 	
-	ui_start(&ui);
+	/* Force a screen to be displayed on the OSD -- V1.50 ACM */
+	//m.acm.cpu.pc = 0xD051; // Blank screen ($00, $20 ...)
+	//m.acm.cpu.pc = 0xD048; // Transparent screen ($81, $00 ...)
+	//m.acm.cpu.pc = 0xD26A; // Blank screen ($00, $20 ... same as D051?)
+	//m.acm.cpu.pc = 0xD8E8; // Blank screen ($80 on top line, $81 on other, $00 ...)
+	//m.acm.cpu.pc = 0xD002; // "HELP". Shows parental control number.
+	//m.acm.cpu.pc = 0xC640; // "PROGRAM CONTROL"
+	//m.acm.cpu.pc = 0xC69B; // "EQUIPMENT AUTH NUMBER" screen
+	//m.acm.cpu.pc = 0xC795; // "PARENTAL CONTROL"
+	//m.acm.cpu.pc = 0xCA33; // "PARENTAL CONTROL NUMBER"
+	//m.acm.cpu.pc = 0xCA43; // "PAY-TV NUMBER"
+	//m.acm.cpu.pc = 0xC18D; // "DIAGNOSTIC DATA" incomplete (requires ACM bus link?)
+	//m.acm.cpu.pc = 0xCB5E; // "PAY-TV HISTORY"
+	//m.acm.cpu.pc = 0xCDF0; // "PERSONAL MESSAGES"
 	
-	/* Configure SRB1 system (4 MHz clock) */
-	_srb1_memory_init(&srb1);
-	cpu_ccu3000_init(&srb1.ccu, 4000000, 1, &srb1.mem);
-	srb1.ccu.p5_data_in = 0xFF;
-	srb1.ccu.p6_data_in = 0xFF;
-	srb1.ccu.p8_data_in = 0xFF;
-	srb1.ccu.core.verbose = 0;
+	/* Keep to the SRB1 clock */
+	pace_init(&pace, m.srb1.ccu.core.clock_num, m.srb1.ccu.core.clock_den, ui.speed, m.srb1.ccu.core.cycle);
 	
-	/* Configure ACM system (8 MHz clock - it's not) */
-	_acm_memory_init(&acm);
-	cpu_65c02_init(&acm.cpu, 8000000, 1, &acm.mem);
-	acm.osd = ui.osd;
-	acm.cpu.verbose = 0;
+	t = hoststat_now();
 	
-	/* Force a screen to be displayed on the OSD -- V1.50 ACM */
-	//acm.cpu.pc = 0xD051; // Blank screen ($00, $20 ...)
-	//acm.cpu.pc = 0xD048; // Transparent screen ($81, $00 ...)
-	//acm.cpu.pc = 0xD26A; // Blank screen ($00, $20 ... same as D051?)
-	//acm.cpu.pc = 0xD8E8; // Blank screen ($80 on top line, $81 on other, $00 ...)
-	//acm.cpu.pc = 0xD002; // "HELP". Shows parental control number.
-	//acm.cpu.pc = 0xC640; // "PROGRAM CONTROL"
-	//acm.cpu.pc = 0xC69B; // "EQUIPMENT AUTH NUMBER" screen
-	//acm.cpu.pc = 0xC795; // "PARENTAL CONTROL"
-	//acm.cpu.pc = 0xCA33; // "PARENTAL CONTROL NUMBER"
-	//acm.cpu.pc = 0xCA43; // "PAY-TV NUMBER"
-	//acm.cpu.pc = 0xC18D; // "DIAGNOSTIC DATA" incomplete (requires ACM bus link?)
-	//acm.cpu.pc = 0xCB5E; // "PAY-TV HISTORY"
-	//acm.cpu.pc = 0xCDF0; // "PERSONAL MESSAGES"
-	
-	while(!ui.done)
-	{
-		cpu_ccu3000_exec(&srb1.ccu);
-		cpu_65c02_exec(&acm.cpu);
+	while(!ui.done && !stop)
+	{
+		if(ui.paused)
+		{
+			/* Stopped by a watch, the debugger or the pause key */
+			if(gdb_addr) gdbstub_poll(&gdb);
+			if(monitor) monitor_poll(&mon);
+			usleep(10000);
+			paused = 1;
+			continue;
+		}
 		
-		/* Update the LED display */
-		/* The LEDs are illuminated if pin is output 1, or input */
-		if((~srb1.ccu.p8_data | srb1.ccu.p8_ddr) & (1 << 3))
+		if(paused)
 		{
-			ui.lsd = ~srb1.ccu.p6_data | srb1.ccu.p6_ddr;
+			/* Carry on from here */
+			watch_clear(&w_srb1);
+			watch_clear(&w_acm);
+			pace_set_speed(&pace, ui.speed, m.srb1.ccu.core.cycle);
+			t = hoststat_now();
+			paused = 0;
 		}
-		else
+		
+		/* Run the SRB1 up to the next event or the end of the slice */
+		next = m.srb1.ccu.core.cycle + SLICE_CYCLES;
+		if(m.sched.next < next) next = m.sched.next;
+		if(monitor && mon.until && mon.until < next) next = mon.until;
+		if(replay && journal.next < next) next = journal.next;
+		
+		while(m.srb1.ccu.core.cycle < next)
 		{
-			//ui.lsd = 0;
+			if(watch_exec(&w_srb1))
+			{
+				break;
+			}
+			
+			cpu_ccu3000_exec(&m.srb1.ccu);
+			
+			/* Nothing can change until the next event if it's idle */
+			if(m.srb1.ccu.core.idle)
+			{
+				cpu_65c02_idle_skip(&m.srb1.ccu.core, next);
+			}
+			
+			if(lockstep && !lockstep->no_idle)
+			{
+				shadow.engine->exec(&shadow.srb1.ccu.core);
+				cpu_65c02_idle_skip(&shadow.srb1.ccu.core, next);
+				
+				if(lockstep_check(&ls_srb1) != 0)
+				{
+					stop = 1;
+					break;
+				}
+			}
+			
+			if(w_srb1.hit)
+			{
+				/* A memory watch */
+				break;
+			}
 		}
 		
-		if((~srb1.ccu.p8_data | srb1.ccu.p8_ddr) & (1 << 2))
+		/* The copy runs every idle loop, so it only agrees once
+		 * it has caught up to the same point */
+		if(lockstep && lockstep->no_idle && !stop)
 		{
-			ui.msd = ~srb1.ccu.p6_data | srb1.ccu.p6_ddr;
+			while(shadow.srb1.ccu.core.cycle < m.srb1.ccu.core.cycle)
+			{
+				shadow.engine->exec(&shadow.srb1.ccu.core);
+			}
+			
+			stop = lockstep_check(&ls_srb1) != 0;
 		}
-		else
+		
+		next = m.srb1.ccu.core.cycle * m.acm.cpu.clock_num / m.srb1.ccu.core.clock_num;
+		
+		/* Bring the ACM up to the same time, even if the SRB1 has
+		 * stopped, so both stop at the same point */
+		while(m.acm.cpu.cycle < next && !stop && !w_acm.hit)
+		{
+			if(watch_exec(&w_acm))
+			{
+				break;
+			}
+			
+			/* Replaced with native code at the start of a known routine */
+			if(!hle.page[m.acm.cpu.pc >> 8] || !hle_exec(&hle))
+			{
+				cpu_65c02_exec(&m.acm.cpu);
+			}
+			
+			if(m.acm.cpu.idle)
+			{
+				cpu_65c02_idle_skip(&m.acm.cpu, next);
+			}
+			
+			if(lockstep && !lockstep->no_idle)
+			{
+				shadow.engine->exec(&shadow.acm.cpu);
+				cpu_65c02_idle_skip(&shadow.acm.cpu, next);
+				
+				if(lockstep_check(&ls_acm) != 0)
+				{
+					stop = 1;
+				}
+			}
+			
+			if(w_acm.hit)
+			{
+				/* A memory watch */
+				break;
+			}
+		}
+		
+		if(lockstep && lockstep->no_idle && !stop)
+		{
+			while(shadow.acm.cpu.cycle < m.acm.cpu.cycle)
+			{
+				shadow.engine->exec(&shadow.acm.cpu);
+			}
+			
+			stop = lockstep_check(&ls_acm) != 0;
+		}
+		
+		if(w_srb1.hit || w_acm.hit)
+		{
+			_watch_hit(&w_srb1, &w_acm, &ui);
+		}
+		
+		if(stats_name) ns[HOSTSTAT_CORE] = hoststat_lap(&t);
+		
+		/* Both systems are at the end of the boot, before its events */
+		if(save && m.srb1.ccu.core.cycle >= MACHINE_BOOT_CYCLES)
+		{
+			machine_save(&m, state, hash);
+			save = 0;
+		}
+		
+		sched_run(&m.sched, m.srb1.ccu.core.cycle);
+		
+		if(lockstep)
 		{
-			//ui.msd = 0;
+			sched_run(&shadow.sched, shadow.srb1.ccu.core.cycle);
 		}
 		
-		/* Update the buttons (pressed = 0) */
-		srb1.ccu.p6_data_in = ~ui.buttons;
+		if(stats_name) ns[HOSTSTAT_SCHED] = hoststat_lap(&t);
+		
+		if(gdb_addr) gdbstub_poll(&gdb);
+		if(monitor) monitor_poll(&mon);
+		
+		/* The buttons come from the UI, or the journal when replaying */
+		pressed = replay ? buttons : ui.buttons;
+		
+		while(replay && journal.next <= m.srb1.ccu.core.cycle)
+		{
+			if(journal.type == JOURNAL_BUTTONS)
+			{
+				pressed = journal.value;
+			}
+			else if(journal.type == JOURNAL_END)
+			{
+				/* Stop where the recording did */
+				printf("journal: replay ended at cycle %lu\n", journal.next);
+				ui.paused = 1;
+			}
+			
+			journal_read(&journal);
+		}
 		
-		if(srb1.ccu.core.cycle >= 794930)
+		/* Update the buttons when one changes (pressed = 0) */
+		if(pressed != buttons)
 		{
-			if(counter % 4000 == 1000 - 1)
+			buttons = pressed;
+			cpu_ccu3000_port_input(&m.srb1.ccu, 6, ~buttons);
+			
+			if(lockstep)
 			{
-				/* Trigger a Timer1 interrupt */
-				//printf("* Timer1 interrupt\n");
-				cpu_ccu3000_irq_custom(&srb1.ccu, _srb1_memory_read(&srb1, 0xFFF6) | (_srb1_memory_read(&srb1, 0xFFF7) << 8), 0);
+				cpu_ccu3000_port_input(&shadow.srb1.ccu, 6, ~buttons);
 			}
-			else if(counter % 4000 == 2000 - 1)
+			
+			if(record)
 			{
-				/* Trigger a Timer2 interrupt */
-				//printf("* Timer2 interrupt\n");
-				cpu_ccu3000_irq_custom(&srb1.ccu, _srb1_memory_read(&srb1, 0xFFF4) | (_srb1_memory_read(&srb1, 0xFFF5) << 8), 0);
+				journal_write(&journal, m.srb1.ccu.core.cycle, JOURNAL_BUTTONS, buttons);
 			}
-			//else if(counter % 4000 == 3000 - 1)
-			//{
-			//	/* Trigger a Timer3 interrupt */
-			//	printf("* Timer3 interrupt\n");
-			//	cpu_ccu3000_irq_custom(&srb1.ccu, _srb1_memory_read(&srb1, 0xFFF2) | (_srb1_memory_read(&srb1, 0xFFF3) << 8), 0);
-			//}
 		}
 		
-		counter++;
+		if(stats_name) ns[HOSTSTAT_UI] = hoststat_lap(&t);
+		
+		/* Wait for real time to catch up */
+		if(ui.speed != pace.speed)
+		{
+			pace_set_speed(&pace, ui.speed, m.srb1.ccu.core.cycle);
+		}
+		
+		pace_sync(&pace, m.srb1.ccu.core.cycle);
+		
+		if(stats_name)
+		{
+			ns[HOSTSTAT_IO] = 0;
+			ns[HOSTSTAT_SLEEP] = hoststat_lap(&t);
+			hoststat_slice(&stats, ns, m.srb1.ccu.core.cycle, m.acm.cpu.cycle);
+		}
 	}
 	
 	ui_end(&ui);
+	log_stop();
+	pace_dump(&pace);
+	
+	if(io_counts)
+	{
+		machine_io_dump(&m);
+	}
+	
+	if(hooks)
+	{
+		hle_dump(&hle);
+	}
+	
+	hle_free(&hle);
+	
+	if(record || replay)
+	{
+		journal_close(&journal, m.srb1.ccu.core.cycle);
+	}
+	
+	if(m.srb1.ccu.wd_resets || m.srb1.ccu.wd_near_misses)
+	{
+		printf("ccu: watchdog: %lu resets, %lu near misses\n",
+			m.srb1.ccu.wd_resets, m.srb1.ccu.wd_near_misses);
+	}
+	
+	if(gdb_addr)
+	{
+		gdbstub_free(&gdb);
+	}
+	
+	if(monitor)
+	{
+		monitor_free(&mon);
+	}
+	
+	if(lockstep && !stop)
+	{
+		printf("lockstep: %s matched for %lu SRB1 and %lu ACM %s\n",
+			lockstep->name, ls_srb1.count, ls_acm.count,
+			lockstep->no_idle ? "events" : "instructions");
+	}
+	
+	if(stats_name)
+	{
+		hoststat_dump(&stats);
+		hoststat_free(&stats);
+	}
+	
+	if(profile)
+	{
+		profile_write(m.srb1.ccu.core.prof, profile);
+		profile_write(m.acm.cpu.prof, profile);
+	}
 	
-	return(0);
+	return(stop ? 1 : 0);
 }
 
@@ -0,0 +1,518 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include "monitor.h"
+
+static const char _help[] =
+	"r                    Registers of both CPUs\n"
+	"cpu srb1|acm         Select the CPU for the commands below\n"
+	"d [addr [end]]       Disassemble, 16 instructions by default\n"
+	"m [addr [end]]       Dump memory, 128 bytes by default\n"
+	"e addr v [v ...]     Enter bytes at addr (ROM can be patched)\n"
+	"io                   CCU timers and ports\n"
+	"ioc                  I/O access counts, * where unhandled\n"
+	"b addr               Set a breakpoint, bc addr to clear it\n"
+	"w addr[-end] [r|w]   Set a read and/or write watch, wc to clear it\n"
+	"s [n]                Step n instructions (paused)\n"
+	"g n                  Run n cycles and pause\n"
+	"c                    Continue\n"
+	"p                    Pause\n"
+	"q                    Quit\n"
+	"Addresses and bytes are hex, counts decimal. Addresses can also\n"
+	"be symbols, a data symbol standing for its whole range.\n";
+
+static void _regs(struct monitor_t *s, int i)
+{
+	struct cpu_65c02_t *cpu = s->cpu[i];
+	uint8_t p = cpu_65c02_status(cpu);
+	char name[SYMBOLS_TEXT];
+	char text[DISASM_TEXT];
+	uint8_t b[3];
+	int j;
+	
+	for(j = 0; j < 3; j++)
+	{
+		b[j] = watch_peek(s->watch[i], cpu->pc + j);
+	}
+	
+	cpu_65c02_disasm(text, cpu->pc, b);
+	symbols_format(s->sym[i], cpu->pc, name);
+	
+	printf("%-4s PC:%04X A:%02X X:%02X Y:%02X SP:%02X P:%02X %c%c-%c%c%c%c%c cycle %lu  %s%s%s%s\n",
+		s->name[i], cpu->pc, cpu->a, cpu->x, cpu->y, cpu->sp, p,
+		p & 0x80 ? 'N' : '.', p & 0x40 ? 'V' : '.', p & 0x10 ? 'B' : '.',
+		p & 0x08 ? 'D' : '.', p & 0x04 ? 'I' : '.', p & 0x02 ? 'Z' : '.',
+		p & 0x01 ? 'C' : '.', cpu->cycle, text,
+		*name ? "  <" : "", name, *name ? ">" : "");
+}
+
+static void _disasm(struct monitor_t *s, uint16_t addr, long end)
+{
+	struct disasm_t *d = &s->dis[s->sel];
+	const struct symbol_t *sym;
+	char name[SYMBOLS_TEXT];
+	char text[DISASM_TEXT];
+	uint16_t target;
+	const char *t;
+	uint8_t b[3];
+	int n, i, len;
+	
+	addr = disasm_align(d, addr);
+	
+	for(n = 0; end < 0 ? n < 16 : addr <= end; n++)
+	{
+		if(disasm_contains(d, addr))
+		{
+			/* Pre-decoded */
+			len = d->len[addr - d->base];
+			t = d->text[addr - d->base];
+		}
+		else
+		{
+			for(i = 0; i < 3; i++)
+			{
+				b[i] = watch_peek(s->watch[s->sel], addr + i);
+			}
+			
+			len = cpu_65c02_disasm(text, addr, b);
+			t = text;
+		}
+		
+		/* A label line where a symbol starts */
+		sym = symbols_lookup(s->sym[s->sel], addr);
+		if(sym && sym->start == addr)
+		{
+			printf("%s:\n", sym->name);
+		}
+		
+		printf("%04X ", addr);
+		
+		for(i = 0; i < 3; i++)
+		{
+			b[i] = watch_peek(s->watch[s->sel], addr + i);
+			
+			if(i < len) printf(" %02X", b[i]);
+			else printf("   ");
+		}
+		
+		/* And the symbol the operand refers to */
+		if(len > 1 && cpu_65c02_operand(addr, b, &target) && *symbols_format(s->sym[s->sel], target, name))
+		{
+			printf("  %-14s ; %s\n", t, name);
+		}
+		else
+		{
+			printf("  %s\n", t);
+		}
+		
+		if(addr + len > 0xFFFF)
+		{
+			break;
+		}
+		
+		addr += len;
+	}
+	
+	s->dis_next = addr;
+}
+
+static void _dump(struct monitor_t *s, uint16_t addr, long end)
+{
+	uint8_t v[16];
+	long a;
+	int i;
+	
+	if(end < 0)
+	{
+		end = addr + 127;
+	}
+	
+	for(a = addr; a <= end && a <= 0xFFFF; a += 16)
+	{
+		printf("%04lX ", a);
+		
+		for(i = 0; i < 16; i++)
+		{
+			v[i] = watch_peek(s->watch[s->sel], a + i);
+			printf(" %02X", v[i]);
+		}
+		
+		printf("  ");
+		
+		for(i = 0; i < 16; i++)
+		{
+			putchar(v[i] >= 0x20 && v[i] < 0x7F ? v[i] : '.');
+		}
+		
+		putchar('\n');
+	}
+	
+	s->mem_next = a;
+}
+
+static void _step(struct monitor_t *s, long n)
+{
+	struct machine_t *m = s->m;
+	
+	for(; n > 0; n--)
+	{
+		cpu_65c02_exec(s->cpu[s->sel]);
+		
+		/* Let any timer events due by now happen */
+		sched_run(&m->sched, m->srb1.ccu.core.cycle);
+	}
+	
+	_regs(s, s->sel);
+}
+
+static int _addr(const struct symbols_t *sym, const char *p, long *start, long *end)
+{
+	const struct symbol_t *n = symbols_find(sym, p);
+	char *e;
+	
+	/* A code label is one address, a data label its whole range */
+	if(n)
+	{
+		*start = n->start;
+		*end = n->data ? n->end : n->start;
+		return(0);
+	}
+	
+	if(*p == '$') p++;
+	
+	*start = strtol(p, &e, 16);
+	if(e == p || *start < 0 || *start > 0xFFFF)
+	{
+		return(-1);
+	}
+	
+	*end = *start;
+	
+	if(*e == '-')
+	{
+		p = e + 1;
+		if(*p == '$') p++;
+		*end = strtol(p, &e, 16);
+		
+		if(*end < *start || *end > 0xFFFF)
+		{
+			return(-1);
+		}
+	}
+	
+	return(0);
+}
+
+static void _command(struct monitor_t *s, char *line)
+{
+	char *argv[18];
+	int argc = 0;
+	long start, end;
+	char *p;
+	int i, r;
+	
+	for(p = strtok(line, " \t\r\n"); p && argc < 18; p = strtok(NULL, " \t\r\n"))
+	{
+		argv[argc++] = p;
+	}
+	
+	if(argc == 0)
+	{
+		return;
+	}
+	
+	if(strcmp(argv[0], "h") == 0 || strcmp(argv[0], "?") == 0)
+	{
+		printf("%s", _help);
+	}
+	else if(strcmp(argv[0], "r") == 0)
+	{
+		_regs(s, 0);
+		_regs(s, 1);
+	}
+	else if(strcmp(argv[0], "cpu") == 0 && argc == 2)
+	{
+		for(i = 0; i < 2 && strcmp(argv[1], s->name[i]) != 0; i++);
+		
+		if(i == 2)
+		{
+			printf("Unknown CPU '%s'\n", argv[1]);
+			return;
+		}
+		
+		s->sel = i;
+		s->dis_pc = s->dis_next = s->cpu[i]->pc;
+		s->mem_next = 0x0000;
+	}
+	else if(strcmp(argv[0], "d") == 0 || strcmp(argv[0], "m") == 0)
+	{
+		uint16_t addr = argv[0][0] == 'd' ? s->dis_next : s->mem_next;
+		
+		/* Disassemble from the PC if the CPU has moved on */
+		if(argv[0][0] == 'd' && s->cpu[s->sel]->pc != s->dis_pc)
+		{
+			addr = s->cpu[s->sel]->pc;
+		}
+		
+		end = -1;
+		
+		if(argc >= 2)
+		{
+			if(_addr(s->sym[s->sel], argv[1], &start, &end) != 0)
+			{
+				printf("Bad address '%s'\n", argv[1]);
+				return;
+			}
+			
+			addr = start;
+			end = end == start ? -1 : end;
+		}
+		
+		if(argc >= 3)
+		{
+			long dummy;
+			
+			if(_addr(s->sym[s->sel], argv[2], &end, &dummy) != 0 || end < addr)
+			{
+				printf("Bad address '%s'\n", argv[2]);
+				return;
+			}
+		}
+		
+		if(argv[0][0] == 'd')
+		{
+			_disasm(s, addr, end);
+			s->dis_pc = s->cpu[s->sel]->pc;
+		}
+		else
+		{
+			_dump(s, addr, end);
+		}
+	}
+	else if(strcmp(argv[0], "e") == 0 && argc >= 3)
+	{
+		struct disasm_t *d = &s->dis[s->sel];
+		
+		if(_addr(s->sym[s->sel], argv[1], &start, &end) != 0)
+		{
+			printf("Bad address '%s'\n", argv[1]);
+			return;
+		}
+		
+		for(i = 2; i < argc; i++)
+		{
+			watch_poke(s->watch[s->sel], start + i - 2, strtol(argv[i], NULL, 16));
+		}
+		
+		/* Decode a patched ROM again */
+		if(disasm_contains(d, start) || disasm_contains(d, start + argc - 3))
+		{
+			const uint8_t *rom = d->rom;
+			const uint8_t *map = d->map;
+			uint16_t base = d->base;
+			uint32_t size = d->size;
+			
+			disasm_free(d);
+			disasm_init(d, rom, map, base, size);
+		}
+	}
+	else if(strcmp(argv[0], "io") == 0)
+	{
+		cpu_ccu3000_dump(&s->m->srb1.ccu);
+	}
+	else if(strcmp(argv[0], "ioc") == 0)
+	{
+		machine_io_dump(s->m);
+	}
+	else if((strcmp(argv[0], "b") == 0 || strcmp(argv[0], "bc") == 0) && argc == 2)
+	{
+		if(_addr(s->sym[s->sel], argv[1], &start, &end) != 0)
+		{
+			printf("Bad address '%s'\n", argv[1]);
+			return;
+		}
+		
+		if(argv[0][1] == 'c') r = watch_remove(s->watch[s->sel], WATCH_EXEC, start, end);
+		else r = watch_add(s->watch[s->sel], WATCH_EXEC, start, end);
+		
+		if(r != 0)
+		{
+			printf("Failed\n");
+		}
+	}
+	else if((strcmp(argv[0], "w") == 0 || strcmp(argv[0], "wc") == 0) && argc >= 2)
+	{
+		int type = WATCH_READ | WATCH_WRITE;
+		
+		if(_addr(s->sym[s->sel], argv[1], &start, &end) != 0)
+		{
+			printf("Bad address '%s'\n", argv[1]);
+			return;
+		}
+		
+		if(argc >= 3)
+		{
+			type = 0;
+			if(strchr(argv[2], 'r')) type |= WATCH_READ;
+			if(strchr(argv[2], 'w')) type |= WATCH_WRITE;
+		}
+		
+		if(argv[0][1] == 'c') r = watch_remove(s->watch[s->sel], type, start, end);
+		else r = watch_add(s->watch[s->sel], type, start, end);
+		
+		if(r != 0 || type == 0)
+		{
+			printf("Failed\n");
+		}
+	}
+	else if(strcmp(argv[0], "s") == 0)
+	{
+		if(!*s->paused)
+		{
+			printf("Pause first\n");
+			return;
+		}
+		
+		_step(s, argc >= 2 ? atol(argv[1]) : 1);
+	}
+	else if(strcmp(argv[0], "g") == 0 && argc == 2)
+	{
+		struct cpu_65c02_t *srb1 = s->cpu[0];
+		
+		/* The main loop runs on SRB1 time */
+		s->until = srb1->cycle + atol(argv[1]) * srb1->clock_num / s->cpu[s->sel]->clock_num;
+		*s->paused = 0;
+	}
+	else if(strcmp(argv[0], "c") == 0)
+	{
+		*s->paused = 0;
+	}
+	else if(strcmp(argv[0], "p") == 0)
+	{
+		*s->paused = 1;
+		_regs(s, 0);
+		_regs(s, 1);
+	}
+	else if(strcmp(argv[0], "q") == 0)
+	{
+		*s->quit = 1;
+	}
+	else
+	{
+		printf("Unknown command '%s', h for help\n", argv[0]);
+	}
+}
+
+int monitor_init(struct monitor_t *s, struct machine_t *m, struct watch_t *srb1, struct watch_t *acm, int *paused, int *quit)
+{
+	memset(s, 0, sizeof(struct monitor_t));
+	
+	s->fd = STDIN_FILENO;
+	s->m = m;
+	s->cpu[0] = &m->srb1.ccu.core;
+	s->cpu[1] = &m->acm.cpu;
+	s->watch[0] = srb1;
+	s->watch[1] = acm;
+	s->name[0] = "srb1";
+	s->name[1] = "acm";
+	s->sym[0] = &m->srb1.sym;
+	s->sym[1] = &m->acm.sym;
+	s->paused = paused;
+	s->quit = quit;
+	s->dis_pc = s->dis_next = s->cpu[0]->pc;
+	
+	if(disasm_init(&s->dis[0], m->srb1.rom, m->srb1.map, 0x8000, 0x8000) != 0 ||
+	   disasm_init(&s->dis[1], m->acm.rom, m->acm.map, 0x8000, 0x8000) != 0)
+	{
+		monitor_free(s);
+		return(-1);
+	}
+	
+	printf("monitor: ready, h for help\n");
+	
+	return(0);
+}
+
+void monitor_poll(struct monitor_t *s)
+{
+	struct pollfd pfd;
+	char *nl;
+	int r;
+	
+	if(s->until && s->cpu[0]->cycle >= s->until)
+	{
+		/* Finished a run of n cycles */
+		s->until = 0;
+		*s->paused = 1;
+		_regs(s, 0);
+		_regs(s, 1);
+	}
+	
+	if(s->fd < 0)
+	{
+		return;
+	}
+	
+	pfd.fd = s->fd;
+	pfd.events = POLLIN;
+	
+	if(poll(&pfd, 1, 0) <= 0)
+	{
+		return;
+	}
+	
+	r = read(s->fd, s->line + s->len, sizeof(s->line) - s->len - 1);
+	
+	if(r <= 0)
+	{
+		/* End of input, leave the emulator running */
+		s->fd = -1;
+		return;
+	}
+	
+	s->len += r;
+	s->line[s->len] = '\0';
+	
+	while((nl = strchr(s->line, '\n')))
+	{
+		*nl = '\0';
+		_command(s, s->line);
+		
+		s->len -= nl + 1 - s->line;
+		memmove(s->line, nl + 1, s->len + 1);
+	}
+	
+	if(s->len == sizeof(s->line) - 1)
+	{
+		/* Too long to be a command */
+		s->len = 0;
+	}
+	
+	fflush(stdout);
+}
+
+void monitor_free(struct monitor_t *s)
+{
+	disasm_free(&s->dis[0]);
+	disasm_free(&s->dis[1]);
+}
+
@@ -0,0 +1,64 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef _MONITOR_H
+#define _MONITOR_H
+
+#include <stdint.h>
+#include "machine.h"
+#include "watch.h"
+#include "disasm.h"
+
+#define MONITOR_LINE 256
+
+/* Command console on stdin, polled from the main loop */
+struct monitor_t {
+	int fd;
+	
+	struct machine_t *m;
+	struct cpu_65c02_t *cpu[2];
+	struct watch_t *watch[2];
+	const char *name[2];
+	const struct symbols_t *sym[2];
+	
+	/* Pre-decoded ROM of each CPU */
+	struct disasm_t dis[2];
+	
+	/* The emulator's pause and quit flags */
+	int *paused;
+	int *quit;
+	
+	/* The CPU commands apply to, and where d and m carry on from.
+	 * d starts from the PC again once it moves away from dis_pc */
+	int sel;
+	uint16_t dis_next;
+	uint16_t dis_pc;
+	uint16_t mem_next;
+	
+	/* SRB1 cycle to pause at, or 0 */
+	uint64_t until;
+	
+	char line[MONITOR_LINE];
+	int len;
+};
+
+extern int monitor_init(struct monitor_t *s, struct machine_t *m, struct watch_t *srb1, struct watch_t *acm, int *paused, int *quit);
+extern void monitor_poll(struct monitor_t *s);
+extern void monitor_free(struct monitor_t *s);
+
+#endif
+
@@ -0,0 +1,117 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include "pace.h"
+
+/* Give up catching up if the emulation falls this far behind (ns) */
+#define _RESYNC_LIMIT 100000000
+
+static int64_t _ns(const struct timespec *ts)
+{
+	return((int64_t) ts->tv_sec * 1000000000 + ts->tv_nsec);
+}
+
+void pace_init(struct pace_t *s, int clock_num, int clock_den, int speed, uint64_t cycle)
+{
+	memset(s, 0, sizeof(struct pace_t));
+	
+	s->clock_num = clock_num;
+	s->clock_den = clock_den;
+	
+	pace_set_speed(s, speed, cycle);
+}
+
+void pace_set_speed(struct pace_t *s, int speed, uint64_t cycle)
+{
+	/* Restart timing from here */
+	s->speed = speed;
+	s->base_cycle = cycle;
+	clock_gettime(CLOCK_MONOTONIC, &s->base_time);
+}
+
+void pace_sync(struct pace_t *s, uint64_t cycle)
+{
+	struct timespec ts;
+	int64_t target, now;
+	
+	if(s->speed == 0)
+	{
+		return;
+	}
+	
+	/* Host time when this cycle is due */
+	target = _ns(&s->base_time) + (int64_t) ((double) (cycle - s->base_cycle)
+		* 1e9 * s->clock_den / ((double) s->clock_num * s->speed));
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	now = _ns(&ts);
+	
+	s->drift = now - target;
+	if(s->drift > s->drift_max)
+	{
+		s->drift_max = s->drift;
+	}
+	
+	if(s->drift > _RESYNC_LIMIT)
+	{
+		/* Too far behind, don't try to catch up */
+		pace_set_speed(s, s->speed, cycle);
+		s->resyncs++;
+		return;
+	}
+	
+	if(s->drift >= 0)
+	{
+		return;
+	}
+	
+	ts.tv_sec = target / 1000000000;
+	ts.tv_nsec = target % 1000000000;
+	while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	now = _ns(&ts) - target;
+	
+	s->sleeps++;
+	s->oversleep += now;
+	if(now > s->oversleep_max)
+	{
+		s->oversleep_max = now;
+	}
+}
+
+void pace_dump(struct pace_t *s)
+{
+	fprintf(stderr, "pace: speed %dx, drift %.3f ms (max %.3f ms), %lu resyncs\n",
+		s->speed,
+		s->drift / 1e6,
+		s->drift_max / 1e6,
+		s->resyncs
+	);
+	
+	fprintf(stderr, "pace: %lu sleeps, oversleep %.3f us average (max %.3f us)\n",
+		s->sleeps,
+		s->sleeps ? s->oversleep / 1e3 / s->sleeps : 0.0,
+		s->oversleep_max / 1e3
+	);
+}
+
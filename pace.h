@@ -0,0 +1,53 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef _PACE_H
+#define _PACE_H
+
+#include <stdint.h>
+#include <time.h>
+
+struct pace_t {
+	
+	/* Emulated clock rate */
+	int clock_num;
+	int clock_den;
+	
+	/* Multiple of real time, or 0 for unlimited */
+	int speed;
+	
+	/* Reference point, emulated cycle against host time */
+	uint64_t base_cycle;
+	struct timespec base_time;
+	
+	/* Statistics. Drift is how far the emulation is running
+	 * behind the host clock, oversleep is how late sleeps return */
+	int64_t drift;
+	int64_t drift_max;
+	uint64_t sleeps;
+	int64_t oversleep;
+	int64_t oversleep_max;
+	uint64_t resyncs;
+};
+
+extern void pace_init(struct pace_t *s, int clock_num, int clock_den, int speed, uint64_t cycle);
+extern void pace_set_speed(struct pace_t *s, int speed, uint64_t cycle);
+extern void pace_sync(struct pace_t *s, uint64_t cycle);
+extern void pace_dump(struct pace_t *s);
+
+#endif
+
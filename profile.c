@@ -0,0 +1,328 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpu_65c02.h"
+#include "profile.h"
+
+#define _NO_NODE UINT32_MAX
+
+/* Number of addresses listed in the hot spot report */
+#define _HOT_SPOTS 64
+
+static const uint64_t *_sort_values;
+
+static int _sort_desc(const void *a, const void *b)
+{
+	uint64_t va = _sort_values[*(const uint32_t *) a];
+	uint64_t vb = _sort_values[*(const uint32_t *) b];
+	
+	return(va < vb ? 1 : (va > vb ? -1 : 0));
+}
+
+static uint32_t *_sorted(const uint64_t *values, uint32_t len)
+{
+	uint32_t *idx;
+	uint32_t i;
+	
+	idx = malloc(sizeof(uint32_t) * len);
+	if(!idx)
+	{
+		return(NULL);
+	}
+	
+	for(i = 0; i < len; i++)
+	{
+		idx[i] = i;
+	}
+	
+	_sort_values = values;
+	qsort(idx, len, sizeof(uint32_t), &_sort_desc);
+	
+	return(idx);
+}
+
+static const char *_mnemonic(uint8_t op)
+{
+	const char *m = cpu_65c02_mnemonic(op);
+	return(*m ? m : "???");
+}
+
+static uint32_t _child(struct profile_t *s, uint32_t parent, uint16_t addr)
+{
+	uint32_t h = ((parent * 0x9E3779B1) ^ (addr * 0x85EBCA6B)) & (PROFILE_HASH_SIZE - 1);
+	struct profile_node_t *n;
+	
+	for(; s->hash[h] != _NO_NODE; h = (h + 1) & (PROFILE_HASH_SIZE - 1))
+	{
+		n = &s->node_list[s->hash[h]];
+		
+		if(n->parent == parent && n->addr == addr)
+		{
+			return(s->hash[h]);
+		}
+	}
+	
+	if(s->nodes == PROFILE_MAX_NODES)
+	{
+		/* Out of nodes, charge the caller instead */
+		s->lost++;
+		return(parent);
+	}
+	
+	n = &s->node_list[s->nodes];
+	n->parent = parent;
+	n->addr = addr;
+	n->cycles = 0;
+	s->hash[h] = s->nodes;
+	
+	return(s->nodes++);
+}
+
+struct profile_t *profile_init(const char *name)
+{
+	struct profile_t *s;
+	
+	s = calloc(1, sizeof(struct profile_t));
+	if(!s)
+	{
+		return(NULL);
+	}
+	
+	s->name = name;
+	
+	/* Everything is allocated up front, nothing is allocated while running */
+	s->node_list = calloc(PROFILE_MAX_NODES, sizeof(struct profile_node_t));
+	s->hash = malloc(sizeof(uint32_t) * PROFILE_HASH_SIZE);
+	if(!s->node_list || !s->hash)
+	{
+		profile_free(s);
+		return(NULL);
+	}
+	
+	memset(s->hash, 0xFF, sizeof(uint32_t) * PROFILE_HASH_SIZE);
+	
+	/* Node 0 is the root */
+	s->nodes = 1;
+	
+	return(s);
+}
+
+void profile_free(struct profile_t *s)
+{
+	free(s->node_list);
+	free(s->hash);
+	free(s);
+}
+
+void profile_depth(struct profile_t *s, uint16_t pc, uint8_t depth)
+{
+	if((int8_t) (depth - s->depth) > 0)
+	{
+		/* Entered a subroutine or interrupt at pc */
+		while(s->depth != depth)
+		{
+			s->node = _child(s, s->node, pc);
+			s->stack[++s->depth] = s->node;
+		}
+	}
+	else
+	{
+		/* Returned */
+		s->depth = depth;
+		s->node = s->stack[depth];
+	}
+}
+
+static void _write_report(struct profile_t *s, FILE *f)
+{
+	char name[SYMBOLS_TEXT];
+	uint64_t *fn_cycles;
+	uint64_t count = 0, cycles = 0;
+	uint32_t *idx;
+	uint32_t i;
+	
+	for(i = 0; i < 0x100; i++)
+	{
+		count += s->op_count[i];
+	}
+	
+	for(i = 0; i < 0x10000; i++)
+	{
+		cycles += s->pc_cycles[i];
+	}
+	
+	if(cycles == 0)
+	{
+		cycles = 1;
+	}
+	
+	fprintf(f, "%s: %lu instructions, %lu cycles, %u call graph nodes (%lu lost)\n\n",
+		s->name, count, cycles, s->nodes, s->lost);
+	
+	/* Hot spots by address */
+	idx = _sorted(s->pc_cycles, 0x10000);
+	if(idx)
+	{
+		fprintf(f, "Hot spots:\n");
+		fprintf(f, " Addr   Op  Ins       Cycles       %%   Count  Symbol\n");
+		
+		for(i = 0; i < _HOT_SPOTS && s->pc_cycles[idx[i]]; i++)
+		{
+			fprintf(f, " $%04X  %02X  %-4s %14lu %6.2f%% %14lu  %s\n",
+				idx[i],
+				s->pc_op[idx[i]],
+				_mnemonic(s->pc_op[idx[i]]),
+				s->pc_cycles[idx[i]],
+				100.0 * s->pc_cycles[idx[i]] / cycles,
+				s->pc_count[idx[i]],
+				symbols_format(s->sym, idx[i], name)
+			);
+		}
+		
+		fprintf(f, "\n");
+		free(idx);
+	}
+	
+	/* Opcodes */
+	idx = _sorted(s->op_cycles, 0x100);
+	if(idx)
+	{
+		fprintf(f, "Opcodes:\n");
+		fprintf(f, " Op  Ins           Cycles       %%          Count\n");
+		
+		for(i = 0; i < 0x100 && s->op_count[idx[i]]; i++)
+		{
+			fprintf(f, " %02X  %-4s %16lu %6.2f%% %14lu\n",
+				idx[i],
+				_mnemonic(idx[i]),
+				s->op_cycles[idx[i]],
+				100.0 * s->op_cycles[idx[i]] / cycles,
+				s->op_count[idx[i]]
+			);
+		}
+		
+		fprintf(f, "\n");
+		free(idx);
+	}
+	
+	/* Functions, by cycles spent in the function itself */
+	fn_cycles = calloc(0x10000, sizeof(uint64_t));
+	if(!fn_cycles)
+	{
+		return;
+	}
+	
+	for(i = 1; i < s->nodes; i++)
+	{
+		fn_cycles[s->node_list[i].addr] += s->node_list[i].cycles;
+	}
+	
+	idx = _sorted(fn_cycles, 0x10000);
+	if(idx)
+	{
+		fprintf(f, "Functions (self):\n");
+		fprintf(f, " Entry        Cycles       %%  Symbol\n");
+		
+		for(i = 0; i < _HOT_SPOTS && fn_cycles[idx[i]]; i++)
+		{
+			fprintf(f, " $%04X %14lu %6.2f%%  %s\n",
+				idx[i],
+				fn_cycles[idx[i]],
+				100.0 * fn_cycles[idx[i]] / cycles,
+				symbols_format(s->sym, idx[i], name)
+			);
+		}
+		
+		free(idx);
+	}
+	
+	free(fn_cycles);
+}
+
+static void _write_folded(struct profile_t *s, FILE *f)
+{
+	char name[SYMBOLS_TEXT];
+	uint16_t path[0x100];
+	uint32_t i, n;
+	int d;
+	
+	/* One line per call path: "name;$ADDR;$ADDR cycles", with the
+	 * symbol in place of the address where there is one */
+	for(i = 0; i < s->nodes; i++)
+	{
+		if(s->node_list[i].cycles == 0)
+		{
+			continue;
+		}
+		
+		for(n = i, d = 0; n != 0 && d < 0x100; n = s->node_list[n].parent)
+		{
+			path[d++] = s->node_list[n].addr;
+		}
+		
+		fprintf(f, "%s", s->name);
+		
+		while(d--)
+		{
+			if(*symbols_format(s->sym, path[d], name))
+			{
+				fprintf(f, ";%s", name);
+			}
+			else
+			{
+				fprintf(f, ";$%04X", path[d]);
+			}
+		}
+		
+		fprintf(f, " %lu\n", s->node_list[i].cycles);
+	}
+}
+
+int profile_write(struct profile_t *s, const char *prefix)
+{
+	char filename[256];
+	FILE *f;
+	
+	snprintf(filename, sizeof(filename), "%s.%s.txt", prefix, s->name);
+	f = fopen(filename, "w");
+	if(!f)
+	{
+		perror(filename);
+		return(-1);
+	}
+	
+	_write_report(s, f);
+	fclose(f);
+	
+	snprintf(filename, sizeof(filename), "%s.%s.folded", prefix, s->name);
+	f = fopen(filename, "w");
+	if(!f)
+	{
+		perror(filename);
+		return(-1);
+	}
+	
+	_write_folded(s, f);
+	fclose(f);
+	
+	return(0);
+}
+
@@ -0,0 +1,87 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#include <stdint.h>
+#include "symbols.h"
+
+#define PROFILE_MAX_NODES 0x10000
+#define PROFILE_HASH_SIZE 0x20000
+
+/* A node is one function in one call path, for the call graph */
+struct profile_node_t {
+	uint32_t parent;
+	uint16_t addr;
+	uint64_t cycles;
+};
+
+struct profile_t {
+	
+	/* Name of the CPU, used as the root of the call graph */
+	const char *name;
+	
+	/* Optional symbols, used only when writing the reports */
+	const struct symbols_t *sym;
+	
+	/* Flat counters, by opcode and by address */
+	uint64_t op_count[0x100];
+	uint64_t op_cycles[0x100];
+	uint64_t pc_count[0x10000];
+	uint64_t pc_cycles[0x10000];
+	uint8_t pc_op[0x10000];
+	
+	/* Call graph, following the CPU's JSR depth */
+	uint8_t depth;
+	uint32_t node;
+	uint32_t stack[0x100];
+	uint32_t nodes;
+	uint64_t lost;
+	struct profile_node_t *node_list;
+	uint32_t *hash;
+};
+
+extern struct profile_t *profile_init(const char *name);
+extern void profile_free(struct profile_t *s);
+extern void profile_depth(struct profile_t *s, uint16_t pc, uint8_t depth);
+extern int profile_write(struct profile_t *s, const char *prefix);
+
+static inline void profile_instr(struct profile_t *s, uint16_t pc, uint8_t op, uint8_t depth, uint32_t cycles)
+{
+	if(depth != s->depth)
+	{
+		profile_depth(s, pc, depth);
+	}
+	
+	s->op_count[op]++;
+	s->op_cycles[op] += cycles;
+	s->pc_count[pc]++;
+	s->pc_cycles[pc] += cycles;
+	s->pc_op[pc] = op;
+	s->node_list[s->node].cycles += cycles;
+}
+
+static inline void profile_skip(struct profile_t *s, uint16_t pc, uint64_t cycles)
+{
+	/* Cycles fast-forwarded in an idle loop */
+	s->pc_cycles[pc] += cycles;
+	s->node_list[s->node].cycles += cycles;
+}
+
+#endif
+
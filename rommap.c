@@ -0,0 +1,64 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "rommap.h"
+
+uint8_t *rommap_load(const char *path, uint32_t size)
+{
+	uint8_t *map;
+	FILE *f;
+	
+	f = fopen(path, "rb");
+	if(!f)
+	{
+		return(NULL);
+	}
+	
+	map = malloc(size);
+	
+	/* The map must cover the whole ROM, no more and no less */
+	if(!map || fread(map, 1, size, f) != size || fgetc(f) != EOF)
+	{
+		fprintf(stderr, "%s: not a map of a %u byte ROM, ignored\n", path, size);
+		free(map);
+		map = NULL;
+	}
+	
+	fclose(f);
+	
+	return(map);
+}
+
+int rommap_save(const char *path, const uint8_t *map, uint32_t size)
+{
+	FILE *f;
+	
+	f = fopen(path, "wb");
+	if(!f)
+	{
+		perror(path);
+		return(-1);
+	}
+	
+	fwrite(map, 1, size, f);
+	fclose(f);
+	
+	return(0);
+}
+
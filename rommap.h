@@ -0,0 +1,35 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef _ROMMAP_H
+#define _ROMMAP_H
+
+#include <stdint.h>
+
+/* A code/data map of a ROM, one byte of flags per ROM byte, as written
+ * by romscan. Bytes with no flags set were never reached as code */
+#define ROMMAP_CODE  (1 << 0)	/* Part of an instruction */
+#define ROMMAP_OP    (1 << 1)	/* First byte of an instruction */
+#define ROMMAP_SUB   (1 << 2)	/* Subroutine entry, a JSR target */
+#define ROMMAP_ENTRY (1 << 3)	/* Vector or user supplied entry point */
+#define ROMMAP_JUMP  (1 << 4)	/* Target of a branch or jump */
+
+extern uint8_t *rommap_load(const char *path, uint32_t size);
+extern int rommap_save(const char *path, const uint8_t *map, uint32_t size);
+
+#endif
+
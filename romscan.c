@@ -0,0 +1,615 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Static analysis of a 65C02 ROM. Disassembles recursively from the
+ * vectors and any extra entry points, and writes a code/data map for
+ * the emulator, plus the subroutines and call graph as JSON and DOT */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "cpu_65c02.h"
+#include "disasm.h"
+#include "rommap.h"
+
+#define _NODES_MAX   4096
+#define _EDGES_MAX   0x8000
+#define _ENTRIES_MAX 64
+
+enum {
+	_NEXT,		/* Falls through to the next instruction */
+	_CALL,		/* JSR, then falls through */
+	_BRANCH,	/* Conditional, both paths */
+	_JUMP,		/* Unconditional, to the target only */
+	_INDIRECT,	/* Jump through a pointer */
+	_STOP,		/* RTS, RTI, BRK or STP */
+	_BAD,		/* Undefined opcode */
+};
+
+struct _node_t {
+	uint16_t addr;
+	const char *name;	/* The vector or entry point, if any */
+	int instructions;
+	int bytes;
+};
+
+struct _edge_t {
+	uint16_t from;
+	uint16_t to;
+	int call;		/* JSR, otherwise a jump into another node */
+};
+
+static uint8_t _rom[0x10000];
+static uint8_t _map[0x10000];
+static uint32_t _size;
+static uint16_t _base;
+
+static struct _node_t _nodes[_NODES_MAX];
+static int _node_count;
+static int _node_index[0x10000];
+
+static struct _edge_t _edges[_EDGES_MAX];
+static int _edge_count;
+
+static uint16_t _unresolved[_EDGES_MAX];
+static int _unresolved_count;
+
+static int _seen[0x10000];
+static uint16_t _stack[0x10000];
+static int _overlaps;
+static int _bad;
+
+static int _in_rom(uint16_t addr)
+{
+	return((uint16_t) (addr - _base) < _size);
+}
+
+static uint8_t _byte(uint16_t addr)
+{
+	return(_in_rom(addr) ? _rom[(uint16_t) (addr - _base)] : 0xFF);
+}
+
+static uint16_t _word(uint16_t addr)
+{
+	return(_byte(addr) | (_byte(addr + 1) << 8));
+}
+
+static int _node(uint16_t addr, const char *name)
+{
+	int i = _node_index[addr] - 1;
+	
+	if(i < 0)
+	{
+		if(_node_count == _NODES_MAX)
+		{
+			fprintf(stderr, "Too many subroutines\n");
+			exit(1);
+		}
+		
+		i = _node_count++;
+		_node_index[addr] = i + 1;
+		_nodes[i].addr = addr;
+	}
+	
+	if(name && !_nodes[i].name)
+	{
+		_nodes[i].name = name;
+	}
+	
+	return(i);
+}
+
+static void _edge(uint16_t from, uint16_t to, int call)
+{
+	int i;
+	
+	for(i = 0; i < _edge_count; i++)
+	{
+		if(_edges[i].from == from && _edges[i].to == to)
+		{
+			_edges[i].call |= call;
+			return;
+		}
+	}
+	
+	if(_edge_count == _EDGES_MAX)
+	{
+		fprintf(stderr, "Too many edges\n");
+		exit(1);
+	}
+	
+	_edges[_edge_count].from = from;
+	_edges[_edge_count].to = to;
+	_edges[_edge_count].call = call;
+	_edge_count++;
+}
+
+static void _unresolve(uint16_t addr)
+{
+	int i;
+	
+	for(i = 0; i < _unresolved_count && _unresolved[i] != addr; i++);
+	
+	if(i == _unresolved_count)
+	{
+		_unresolved[_unresolved_count++] = addr;
+	}
+}
+
+static int _decode(uint16_t addr, int *len, uint16_t *target)
+{
+	uint8_t b[3] = { _byte(addr), _byte(addr + 1), _byte(addr + 2) };
+	char text[DISASM_TEXT];
+	uint8_t op = b[0];
+	
+	*len = cpu_65c02_disasm(text, addr, b);
+	*target = b[1] | (b[2] << 8);
+	
+	if(strcmp(text, "???") == 0)
+	{
+		return(_BAD);
+	}
+	
+	switch(op)
+	{
+	case 0x20: return(_CALL);
+	case 0x4C: return(_JUMP);
+	case 0x6C: case 0x7C: return(_INDIRECT);
+	case 0x00: case 0x40: case 0x60: case 0xDB: return(_STOP);
+	case 0x80:
+		*target = addr + 2 + (int8_t) b[1];
+		return(_JUMP);
+	}
+	
+	/* Bxx */
+	if((op & 0x1F) == 0x10)
+	{
+		*target = addr + 2 + (int8_t) b[1];
+		return(_BRANCH);
+	}
+	
+	/* BBRx / BBSx */
+	if((op & 0x0F) == 0x0F)
+	{
+		*target = addr + 3 + (int8_t) b[2];
+		return(_BRANCH);
+	}
+	
+	return(_NEXT);
+}
+
+/* Follows every path through one node without entering its callees,
+ * which are added as nodes of their own */
+static void _scan(int n)
+{
+	uint16_t from = _nodes[n].addr;
+	uint16_t addr, target;
+	int sp = 0;
+	int flow, len, i;
+	
+	_stack[sp++] = from;
+	
+	while(sp > 0)
+	{
+		addr = _stack[--sp];
+		
+		while(_in_rom(addr) && _seen[addr] != n + 1)
+		{
+			_seen[addr] = n + 1;
+			
+			/* Jumping into another node is a tail call */
+			if(addr != from && _node_index[addr])
+			{
+				_edge(from, addr, 0);
+				break;
+			}
+			
+			flow = _decode(addr, &len, &target);
+			
+			if(flow == _BAD)
+			{
+				_bad++;
+				break;
+			}
+			
+			/* Another path decoded these bytes differently */
+			if((_map[addr - _base] & (ROMMAP_CODE | ROMMAP_OP)) == ROMMAP_CODE)
+			{
+				_overlaps++;
+			}
+			
+			_map[addr - _base] |= ROMMAP_OP;
+			for(i = 0; i < len && _in_rom(addr + i); i++)
+			{
+				_map[(uint16_t) (addr + i - _base)] |= ROMMAP_CODE;
+			}
+			
+			_nodes[n].instructions++;
+			_nodes[n].bytes += len;
+			
+			/* A pointer held in ROM can be followed */
+			if(flow == _INDIRECT)
+			{
+				if(_byte(addr) == 0x6C && _in_rom(target) && _in_rom(target + 1))
+				{
+					target = _word(target);
+					flow = _JUMP;
+				}
+				else
+				{
+					_unresolve(addr);
+					break;
+				}
+			}
+			
+			if((flow == _JUMP || flow == _BRANCH) && _in_rom(target))
+			{
+				_map[target - _base] |= ROMMAP_JUMP;
+			}
+			
+			if(flow == _CALL)
+			{
+				if(_in_rom(target))
+				{
+					_map[target - _base] |= ROMMAP_SUB;
+					_node(target, NULL);
+				}
+				
+				_edge(from, target, 1);
+			}
+			else if(flow == _BRANCH)
+			{
+				_stack[sp++] = target;
+			}
+			else if(flow == _JUMP)
+			{
+				addr = target;
+				continue;
+			}
+			else if(flow == _STOP)
+			{
+				break;
+			}
+			
+			addr += len;
+		}
+	}
+}
+
+static int _cmp_node(const void *a, const void *b)
+{
+	return(((const struct _node_t *) a)->addr - ((const struct _node_t *) b)->addr);
+}
+
+static int _cmp_edge(const void *a, const void *b)
+{
+	const struct _edge_t *ea = a, *eb = b;
+	
+	if(ea->from != eb->from)
+	{
+		return(ea->from - eb->from);
+	}
+	
+	return(ea->to - eb->to);
+}
+
+static void _write_edges(FILE *f, int j, uint16_t from, int call)
+{
+	int first = 1;
+	
+	for(; j < _edge_count && _edges[j].from == from; j++)
+	{
+		if(_edges[j].call == call)
+		{
+			fprintf(f, "%s\"%04X\"", first ? "" : ", ", _edges[j].to);
+			first = 0;
+		}
+	}
+}
+
+static void _string(FILE *f, const char *s)
+{
+	/* Quoted, with the characters JSON and DOT don't allow raw escaped */
+	fputc('"', f);
+	
+	for(; *s; s++)
+	{
+		if(*s == '"' || *s == '\\') fprintf(f, "\\%c", *s);
+		else if((unsigned char) *s < 0x20) fprintf(f, "\\u%04X", (unsigned char) *s);
+		else fputc(*s, f);
+	}
+	
+	fputc('"', f);
+}
+
+static int _write_json(const char *path, const char *rom)
+{
+	int code = 0, ops = 0;
+	int i, j;
+	FILE *f;
+	
+	f = fopen(path, "w");
+	if(!f)
+	{
+		perror(path);
+		return(-1);
+	}
+	
+	for(i = 0; i < (int) _size; i++)
+	{
+		if(_map[i] & ROMMAP_CODE) code++;
+		if(_map[i] & ROMMAP_OP) ops++;
+	}
+	
+	fprintf(f, "{\n");
+	fprintf(f, "\t\"rom\": ");
+	_string(f, rom);
+	fprintf(f, ",\n");
+	fprintf(f, "\t\"base\": \"%04X\",\n", _base);
+	fprintf(f, "\t\"size\": %u,\n", _size);
+	fprintf(f, "\t\"code_bytes\": %d,\n", code);
+	fprintf(f, "\t\"instructions\": %d,\n", ops);
+	fprintf(f, "\t\"overlaps\": %d,\n", _overlaps);
+	fprintf(f, "\t\"bad_paths\": %d,\n", _bad);
+	
+	fprintf(f, "\t\"unresolved\": [");
+	for(i = 0; i < _unresolved_count; i++)
+	{
+		fprintf(f, "%s\"%04X\"", i ? ", " : "", _unresolved[i]);
+	}
+	fprintf(f, "],\n");
+	
+	fprintf(f, "\t\"subroutines\": [\n");
+	for(i = 0, j = 0; i < _node_count; i++)
+	{
+		fprintf(f, "\t\t{ \"addr\": \"%04X\", ", _nodes[i].addr);
+		
+		if(_nodes[i].name)
+		{
+			fprintf(f, "\"entry\": \"%s\", ", _nodes[i].name);
+		}
+		
+		fprintf(f, "\"instructions\": %d, \"bytes\": %d, \"calls\": [",
+			_nodes[i].instructions, _nodes[i].bytes);
+		
+		/* The edges are sorted the same way as the nodes */
+		for(; j < _edge_count && _edges[j].from < _nodes[i].addr; j++);
+		
+		_write_edges(f, j, _nodes[i].addr, 1);
+		fprintf(f, "], \"jumps\": [");
+		_write_edges(f, j, _nodes[i].addr, 0);
+		fprintf(f, "] }%s\n", i + 1 < _node_count ? "," : "");
+	}
+	fprintf(f, "\t]\n");
+	fprintf(f, "}\n");
+	
+	fclose(f);
+	
+	return(0);
+}
+
+static int _write_dot(const char *path, const char *name)
+{
+	FILE *f;
+	int i;
+	
+	f = fopen(path, "w");
+	if(!f)
+	{
+		perror(path);
+		return(-1);
+	}
+	
+	fprintf(f, "digraph ");
+	_string(f, name);
+	fprintf(f, " {\n");
+	fprintf(f, "\tnode [shape=box, fontname=monospace];\n");
+	
+	for(i = 0; i < _node_count; i++)
+	{
+		if(_nodes[i].name)
+		{
+			fprintf(f, "\t\"%04X\" [label=\"%04X\\n%s\", style=bold];\n",
+				_nodes[i].addr, _nodes[i].addr, _nodes[i].name);
+		}
+	}
+	
+	/* Tail calls are dashed */
+	for(i = 0; i < _edge_count; i++)
+	{
+		fprintf(f, "\t\"%04X\" -> \"%04X\"%s;\n", _edges[i].from, _edges[i].to,
+			_edges[i].call ? "" : " [style=dashed]");
+	}
+	
+	fprintf(f, "}\n");
+	
+	fclose(f);
+	
+	return(0);
+}
+
+static void _usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options] <rom>\n"
+		"\n"
+		"  -b <addr>   Address the ROM is loaded at (default: ends at $FFFF)\n"
+		"  -c          Also follow the CCU-3000 vectors at $FFF2-$FFF7\n"
+		"  -e <addr>   An extra entry point, may be repeated\n"
+		"  -o <name>   Output name, writes <name>.map, <name>.json and <name>.dot\n"
+		"              (default: the ROM name without its extension)\n",
+		name
+	);
+}
+
+int main(int argc, char *argv[])
+{
+	static const struct {
+		uint16_t addr;
+		const char *name;
+		int ccu;
+	} vectors[] = {
+		{ 0xFFFC, "reset", 0 },
+		{ 0xFFFE, "irq", 0 },
+		{ 0xFFFA, "nmi", 0 },
+		{ 0xFFF6, "timer1", 1 },
+		{ 0xFFF4, "timer2", 1 },
+		{ 0xFFF2, "vec_fff2", 1 },
+	};
+	static char names[_ENTRIES_MAX][16];
+	uint16_t entries[_ENTRIES_MAX];
+	int entry_count = 0;
+	const char *output = NULL;
+	const char *rom;
+	char path[1024];
+	char *ext;
+	long base = -1;
+	int ccu = 0;
+	FILE *f;
+	int c, i;
+	
+	while((c = getopt(argc, argv, "b:ce:o:")) != -1)
+	{
+		switch(c)
+		{
+		case 'b': base = strtol(optarg, NULL, 0) & 0xFFFF; break;
+		case 'c': ccu = 1; break;
+		case 'o': output = optarg; break;
+		case 'e':
+			if(entry_count == _ENTRIES_MAX)
+			{
+				fprintf(stderr, "Too many entry points\n");
+				return(-1);
+			}
+			entries[entry_count++] = strtol(optarg, NULL, 0) & 0xFFFF;
+			break;
+		default: _usage(argv[0]); return(-1);
+		}
+	}
+	
+	if(optind + 1 != argc)
+	{
+		_usage(argv[0]);
+		return(-1);
+	}
+	
+	rom = argv[optind];
+	
+	f = fopen(rom, "rb");
+	if(!f)
+	{
+		perror(rom);
+		return(-1);
+	}
+	
+	_size = fread(_rom, 1, sizeof(_rom), f);
+	fclose(f);
+	
+	if(_size == 0)
+	{
+		fprintf(stderr, "%s: empty\n", rom);
+		return(-1);
+	}
+	
+	_base = base >= 0 ? base : 0x10000 - _size;
+	
+	if(_base + _size > 0x10000)
+	{
+		fprintf(stderr, "%s: does not fit at $%04X\n", rom, _base);
+		return(-1);
+	}
+	
+	/* The vectors come first, then the extra entry points */
+	for(i = 0; i < (int) (sizeof(vectors) / sizeof(*vectors)); i++)
+	{
+		uint16_t addr = _word(vectors[i].addr);
+		
+		if((vectors[i].ccu && !ccu) || !_in_rom(vectors[i].addr) || !_in_rom(addr))
+		{
+			continue;
+		}
+		
+		_map[addr - _base] |= ROMMAP_ENTRY;
+		_node(addr, vectors[i].name);
+	}
+	
+	for(i = 0; i < entry_count; i++)
+	{
+		if(!_in_rom(entries[i]))
+		{
+			fprintf(stderr, "Entry point $%04X is outside the ROM\n", entries[i]);
+			return(-1);
+		}
+		
+		sprintf(names[i], "entry_%04x", entries[i]);
+		_map[entries[i] - _base] |= ROMMAP_ENTRY;
+		_node(entries[i], names[i]);
+	}
+	
+	if(_node_count == 0)
+	{
+		fprintf(stderr, "%s: no entry points\n", rom);
+		return(-1);
+	}
+	
+	/* Scanning a node can add more to the end of the list */
+	for(i = 0; i < _node_count; i++)
+	{
+		_scan(i);
+	}
+	
+	qsort(_nodes, _node_count, sizeof(*_nodes), &_cmp_node);
+	qsort(_edges, _edge_count, sizeof(*_edges), &_cmp_edge);
+	
+	if(!output)
+	{
+		snprintf(path, sizeof(path) - 8, "%s", rom);
+		ext = strrchr(path, '.');
+		if(ext && !strchr(ext, '/')) *ext = '\0';
+	}
+	else
+	{
+		snprintf(path, sizeof(path) - 8, "%s", output);
+	}
+	
+	ext = path + strlen(path);
+	
+	strcpy(ext, ".map");
+	if(rommap_save(path, _map, _size) != 0) return(-1);
+	
+	strcpy(ext, ".json");
+	if(_write_json(path, rom) != 0) return(-1);
+	
+	strcpy(ext, ".dot");
+	if(_write_dot(path, rom) != 0) return(-1);
+	
+	*ext = '\0';
+	
+	for(c = 0, i = 0; i < (int) _size; i++)
+	{
+		if(_map[i] & ROMMAP_CODE) c++;
+	}
+	
+	printf("%s: %d subroutines, %d of %u bytes code, %d unresolved jumps, %d overlaps, %d bad paths\n",
+		rom, _node_count, c, _size, _unresolved_count, _overlaps, _bad);
+	printf("Wrote %s.map, %s.json and %s.dot\n", path, path, path);
+	
+	return(0);
+}
+
@@ -0,0 +1,106 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "sched.h"
+
+static void _update_next(struct sched_t *s)
+{
+	int i;
+	
+	s->next = UINT64_MAX;
+	
+	for(i = 0; i < s->count; i++)
+	{
+		if(s->event[i].cycle < s->next)
+		{
+			s->next = s->event[i].cycle;
+		}
+	}
+}
+
+void sched_init(struct sched_t *s)
+{
+	memset(s, 0, sizeof(struct sched_t));
+	s->next = UINT64_MAX;
+}
+
+int sched_add(struct sched_t *s, uint64_t cycle, sched_callback_t callback, void *private)
+{
+	if(s->count == SCHED_MAX_EVENTS)
+	{
+		fprintf(stderr, "sched: too many events\n");
+		return(-1);
+	}
+	
+	s->event[s->count++] = (struct sched_event_t) { cycle, callback, private };
+	
+	if(cycle < s->next)
+	{
+		s->next = cycle;
+	}
+	
+	return(0);
+}
+
+void sched_remove(struct sched_t *s, sched_callback_t callback, void *private)
+{
+	int i;
+	
+	for(i = 0; i < s->count; )
+	{
+		if(s->event[i].callback == callback &&
+		   s->event[i].private == private)
+		{
+			s->event[i] = s->event[--s->count];
+		}
+		else
+		{
+			i++;
+		}
+	}
+	
+	_update_next(s);
+}
+
+void sched_run(struct sched_t *s, uint64_t cycle)
+{
+	struct sched_event_t e;
+	int i, j;
+	
+	/* Fire every event that is due, earliest first. Callbacks
+	 * are free to add or remove events, including themselves */
+	while(s->next <= cycle)
+	{
+		for(i = 0, j = 0; i < s->count; i++)
+		{
+			if(s->event[i].cycle < s->event[j].cycle)
+			{
+				j = i;
+			}
+		}
+		
+		e = s->event[j];
+		s->event[j] = s->event[--s->count];
+		_update_next(s);
+		
+		e.callback(e.private, e.cycle);
+	}
+}
+
@@ -0,0 +1,48 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef _SCHED_H
+#define _SCHED_H
+
+#include <stdint.h>
+
+#define SCHED_MAX_EVENTS 16
+
+typedef void (*sched_callback_t)(void *private, uint64_t cycle);
+
+struct sched_event_t {
+	uint64_t cycle;
+	sched_callback_t callback;
+	void *private;
+};
+
+struct sched_t {
+	
+	/* Cycle of the earliest pending event, or UINT64_MAX */
+	uint64_t next;
+	
+	int count;
+	struct sched_event_t event[SCHED_MAX_EVENTS];
+};
+
+extern void sched_init(struct sched_t *s);
+extern int sched_add(struct sched_t *s, uint64_t cycle, sched_callback_t callback, void *private);
+extern void sched_remove(struct sched_t *s, sched_callback_t callback, void *private);
+extern void sched_run(struct sched_t *s, uint64_t cycle);
+
+#endif
+
@@ -0,0 +1,170 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "symbols.h"
+
+static int _cmp(const void *a, const void *b)
+{
+	return(((const struct symbol_t *) a)->start - ((const struct symbol_t *) b)->start);
+}
+
+/* Reads lines of the form
+ *
+ *   <addr>[-<end>] <c|d> <name>
+ *
+ * with hex addresses. Blank lines and lines starting with # are ignored.
+ * A missing file leaves the table empty */
+int symbols_load(struct symbols_t *s, const char *path)
+{
+	struct symbol_t *list;
+	char line[256], name[SYMBOLS_TEXT - 8], range[32], type;
+	unsigned int start, end;
+	int ln, i;
+	FILE *f;
+	
+	memset(s, 0, sizeof(struct symbols_t));
+	
+	f = fopen(path, "r");
+	if(!f)
+	{
+		return(-1);
+	}
+	
+	for(ln = 1; fgets(line, sizeof(line), f); ln++)
+	{
+		if(sscanf(line, " %31s", range) != 1 || range[0] == '#')
+		{
+			continue;
+		}
+		
+		if(sscanf(line, " %31s %c %39s", range, &type, name) != 3 ||
+		   (type != 'c' && type != 'd'))
+		{
+			fprintf(stderr, "%s:%d: bad symbol, ignored\n", path, ln);
+			continue;
+		}
+		
+		i = sscanf(range, "%x-%x", &start, &end);
+		if(i < 1 || start > 0xFFFF || (i == 2 && (end > 0xFFFF || end < start)))
+		{
+			fprintf(stderr, "%s:%d: bad address '%s', ignored\n", path, ln, range);
+			continue;
+		}
+		
+		list = realloc(s->list, sizeof(struct symbol_t) * (s->count + 1));
+		if(!list)
+		{
+			break;
+		}
+		
+		s->list = list;
+		s->list[s->count].start = start;
+		s->list[s->count].end = i == 2 ? end : start;
+		s->list[s->count].data = type == 'd';
+		s->list[s->count].name = strdup(name);
+		
+		s->count++;
+	}
+	
+	fclose(f);
+	
+	qsort(s->list, s->count, sizeof(struct symbol_t), &_cmp);
+	
+	return(0);
+}
+
+void symbols_free(struct symbols_t *s)
+{
+	int i;
+	
+	for(i = 0; i < s->count; i++)
+	{
+		free(s->list[i].name);
+	}
+	
+	free(s->list);
+	memset(s, 0, sizeof(struct symbols_t));
+}
+
+const struct symbol_t *symbols_lookup(const struct symbols_t *s, uint16_t addr)
+{
+	int lo = 0, hi = s->count - 1, mid;
+	
+	/* Find the last symbol starting at or before addr */
+	while(lo <= hi)
+	{
+		mid = (lo + hi) / 2;
+		
+		if(s->list[mid].start <= addr)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid - 1;
+		}
+	}
+	
+	if(hi < 0 || addr > s->list[hi].end)
+	{
+		return(NULL);
+	}
+	
+	return(&s->list[hi]);
+}
+
+/* Writes name or name+$offset to out, which must hold SYMBOLS_TEXT
+ * characters. Returns an empty string if no symbol covers addr */
+const char *symbols_format(const struct symbols_t *s, uint16_t addr, char *out)
+{
+	const struct symbol_t *sym = s ? symbols_lookup(s, addr) : NULL;
+	
+	if(!sym)
+	{
+		out[0] = '\0';
+	}
+	else if(addr == sym->start)
+	{
+		sprintf(out, "%s", sym->name);
+	}
+	else
+	{
+		sprintf(out, "%s+$%X", sym->name, addr - sym->start);
+	}
+	
+	return(out);
+}
+
+/* By name, for debugger input only */
+const struct symbol_t *symbols_find(const struct symbols_t *s, const char *name)
+{
+	int i;
+	
+	for(i = 0; i < s->count; i++)
+	{
+		if(strcmp(s->list[i].name, name) == 0)
+		{
+			return(&s->list[i]);
+		}
+	}
+	
+	return(NULL);
+}
+
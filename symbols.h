@@ -0,0 +1,48 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef _SYMBOLS_H
+#define _SYMBOLS_H
+
+#include <stdint.h>
+
+/* Longest formatted name, including any +$offset */
+#define SYMBOLS_TEXT 48
+
+/* A named address or range. Addresses inside a range are shown as
+ * name+$offset. Ranges must not overlap */
+struct symbol_t {
+	uint16_t start;
+	uint16_t end;
+	int data;
+	char *name;
+};
+
+/* Symbols sorted by start address, for lookups by binary search */
+struct symbols_t {
+	struct symbol_t *list;
+	int count;
+};
+
+extern int symbols_load(struct symbols_t *s, const char *path);
+extern void symbols_free(struct symbols_t *s);
+extern const struct symbol_t *symbols_lookup(const struct symbols_t *s, uint16_t addr);
+extern const char *symbols_format(const struct symbols_t *s, uint16_t addr, char *out);
+extern const struct symbol_t *symbols_find(const struct symbols_t *s, const char *name);
+
+#endif
+
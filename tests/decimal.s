@@ -0,0 +1,152 @@
+; ferguson-srb1-emu, decimal mode test image
+;
+; Decimal ADC and SBC of every pair of BCD operands 00-99, with and
+; without carry in, against the sum or difference worked out in binary.
+; Checks A, C, N and Z as the 65C02 sets them. ERROR is left 0 at the
+; success trap, or 1 at fail with the operands in N1, N2 and CIN.
+;
+;   ./bench -i tests/decimal.bin -a 0x400 -p 0x400 -t 0x453 -e 0x05
+
+N1      = $00           ; Operands in BCD
+N2      = $01
+N1B     = $02           ; and in binary
+N2B     = $03
+CIN     = $04           ; Carry in
+ERROR   = $05
+EXPA    = $06           ; Expected result and carry out
+EXPC    = $07
+RES     = $08           ; Flags after the operation
+TABLE   = $0300         ; BCD of 0-99
+
+        .org $0400
+
+start:  cld
+        ldx #$FF
+        txs
+        lda #$01
+        sta ERROR
+        
+        ; The BCD of 0-99, counted without decimal mode
+        ldx #$00
+        lda #$00
+mk:     sta TABLE,x
+        jsr bcdinc
+        inx
+        cpx #100
+        bne mk
+        
+        lda #$00
+        sta N1B
+l1:     ldx N1B
+        lda TABLE,x
+        sta N1
+        lda #$00
+        sta N2B
+l2:     ldx N2B
+        lda TABLE,x
+        sta N2
+        lda #$00
+        sta CIN
+l3:     jsr addtest
+        jsr subtest
+        inc CIN
+        lda CIN
+        cmp #$02
+        bne l3
+        inc N2B
+        lda N2B
+        cmp #100
+        bne l2
+        inc N1B
+        lda N1B
+        cmp #100
+        bne l1
+        
+        lda #$00
+        sta ERROR
+done:   jmp done
+
+fail:   jmp fail
+
+; A = the next BCD number after A
+bcdinc: pha
+        and #$0F
+        cmp #$09
+        pla
+        bcc bi1
+        clc
+        adc #$07
+        rts
+bi1:    clc
+        adc #$01
+        rts
+
+; N1 + N2 + CIN
+addtest:
+        lda N1B
+        clc
+        adc N2B
+        clc
+        adc CIN
+        ldx #$00
+        cmp #100
+        bcc at1
+        sbc #100
+        ldx #$01
+at1:    stx EXPC
+        tax
+        lda TABLE,x
+        sta EXPA
+        
+        lda CIN
+        lsr a
+        lda N1
+        sed
+        adc N2
+        cld
+        php
+        jmp check
+
+; N1 - N2 - (1 - CIN)
+subtest:
+        lda CIN
+        lsr a
+        lda N1B
+        sbc N2B
+        ldx #$01
+        bcs st1
+        adc #100
+        ldx #$00
+st1:    stx EXPC
+        tax
+        lda TABLE,x
+        sta EXPA
+        
+        lda CIN
+        lsr a
+        lda N1
+        sed
+        sbc N2
+        cld
+        php
+        jmp check
+
+; Compare A and the flags on the stack with EXPA and EXPC
+check:  cmp EXPA
+        bne fail
+        pla
+        sta RES
+        and #$01
+        cmp EXPC
+        bne fail
+        lda RES
+        and #$82
+        sta RES
+        lda EXPA
+        and #$80
+        ldx EXPA
+        bne ck1
+        ora #$02
+ck1:    cmp RES
+        bne fail
+        rts
@@ -0,0 +1,422 @@
+; ferguson-srb1-emu, 65C02 extended opcode test image
+;
+; Exercises the instructions and modes the 65C02 adds to the 6502, the
+; fixed JMP ($xxFF), decimal mode flags, BRK clearing D and the lengths
+; of the reserved NOPs. TEST holds the number of the running test; it is
+; left 0 at the success trap, or non-zero at fail.
+;
+;   ./bench -i tests/extended.bin -a 0x400 -p 0x400 -t 0x6a7 -e 0x02
+
+TEST    = $02
+ZP      = $20           ; Scratch bytes in zero page
+PTR     = $30           ; Pointer for the (zp) modes
+DATA    = $2000         ; Scratch bytes outside zero page
+
+        .org $0400
+
+start:  cld
+        ldx #$FF
+        txs
+        
+        ; 1: BRA forwards and backwards
+        lda #$01
+        sta TEST
+        bra t1a
+        jmp fail
+t1b:    bra t1c
+t1a:    bra t1b
+        jmp fail
+t1c:
+        
+        ; 2: PHX, PHY, PLX, PLY
+        lda #$02
+        sta TEST
+        ldx #$5A
+        ldy #$A5
+        phx
+        phy
+        ldx #$00
+        ldy #$00
+        plx
+        ply
+        cpx #$A5
+        bne fail2
+        cpy #$5A
+        bne fail2
+        ldx #$00
+        phx
+        ldx #$01
+        plx
+        bne fail2
+        ldy #$80
+        phy
+        ldy #$00
+        ply
+        bpl fail2
+        
+        ; 3: STZ in all four modes
+        lda #$03
+        sta TEST
+        lda #$FF
+        sta ZP
+        sta ZP+1
+        sta DATA
+        sta DATA+1
+        ldx #$01
+        stz ZP
+        stz ZP,x
+        stz DATA
+        stz DATA,x
+        lda ZP
+        ora ZP+1
+        ora DATA
+        ora DATA+1
+        bne fail2
+        
+        ; 4: INC A and DEC A
+        lda #$04
+        sta TEST
+        lda #$FF
+        inc a
+        bne fail2
+        dec a
+        cmp #$FF
+        bne fail2
+        lda #$7F
+        inc a
+        bpl fail2
+        jmp t5
+        
+fail2:  jmp fail
+        
+        ; 5: TSB and TRB
+t5:     lda #$05
+        sta TEST
+        lda #$0F
+        sta ZP
+        lda #$F0
+        tsb ZP
+        bne fail2
+        lda ZP
+        cmp #$FF
+        bne fail2
+        lda #$0F
+        trb ZP
+        beq fail2
+        lda ZP
+        cmp #$F0
+        bne fail2
+        lda #$0F
+        sta DATA
+        lda #$F0
+        tsb DATA
+        bne fail2
+        lda #$0F
+        trb DATA
+        beq fail2
+        lda DATA
+        cmp #$F0
+        bne fail2
+        
+        ; 6: BIT #, zp,x and abs,x
+        lda #$06
+        sta TEST
+        lda #$C0
+        sta ZP
+        lda #$01
+        bit ZP
+        bit #$01
+        beq fail2
+        bpl fail2
+        bvc fail2
+        ldx #$01
+        lda #$00
+        sta ZP+1
+        lda #$FF
+        bit ZP,x
+        bmi fail2
+        bvs fail2
+        bne fail2
+        lda #$40
+        sta DATA+1
+        bit DATA,x
+        bmi fail2
+        bvc fail2
+        beq fail2
+        
+        ; 7: the (zp) modes
+        lda #$07
+        sta TEST
+        lda #<DATA
+        sta PTR
+        lda #>DATA
+        sta PTR+1
+        lda #$33
+        sta (PTR)
+        lda DATA
+        cmp #$33
+        bne fail3
+        lda #$00
+        lda (PTR)
+        cmp #$33
+        bne fail3
+        lda #$0C
+        ora (PTR)
+        cmp #$3F
+        bne fail3
+        and (PTR)
+        cmp #$33
+        bne fail3
+        eor (PTR)
+        bne fail3
+        clc
+        lda #$01
+        adc (PTR)
+        cmp #$34
+        bne fail3
+        cmp (PTR)
+        bcc fail3
+        beq fail3
+        sec
+        sbc (PTR)
+        cmp #$01
+        bne fail3
+        jmp t8
+        
+fail3:  jmp fail
+        
+        ; 8: JMP (abs,x)
+t8:     lda #$08
+        sta TEST
+        ldx #$02
+        jmp (jtab,x)
+        jmp fail
+jtab:   .word fail, t9
+        
+        ; 9: JMP ($xxFF) takes the high byte from the next page
+t9:     lda #$09
+        sta TEST
+        lda #<t10
+        sta DATA+$FF
+        lda #>t10
+        sta DATA+$100
+        lda #>fail
+        sta DATA
+        jmp (DATA+$FF)
+        
+        ; 10: RMB and SMB
+t10:    lda #$0A
+        sta TEST
+        lda #$00
+        sta ZP
+        smb0 ZP
+        smb1 ZP
+        smb2 ZP
+        smb3 ZP
+        smb4 ZP
+        smb5 ZP
+        smb6 ZP
+        smb7 ZP
+        lda ZP
+        cmp #$FF
+        bne fail3
+        rmb0 ZP
+        rmb1 ZP
+        rmb2 ZP
+        rmb3 ZP
+        rmb4 ZP
+        rmb5 ZP
+        rmb6 ZP
+        rmb7 ZP
+        lda ZP
+        bne fail3
+        
+        ; 11: BBR and BBS on $55, each bit both taken and not
+        lda #$0B
+        sta TEST
+        lda #$55
+        sta ZP
+        bbr0 ZP,fail3
+        bbs1 ZP,fail3
+        bbr2 ZP,fail3
+        bbs3 ZP,fail3
+        bbr4 ZP,fail3
+        bbs5 ZP,fail3
+        bbr6 ZP,fail3
+        bbs7 ZP,fail3
+        bbs0 ZP,b0
+        jmp fail
+b0:     bbr1 ZP,b1
+        jmp fail
+b1:     bbs2 ZP,b2
+        jmp fail
+b2:     bbr3 ZP,b3
+        jmp fail
+b3:     bbs4 ZP,b4
+        jmp fail
+b4:     bbr5 ZP,b5
+        jmp fail
+b5:     bbs6 ZP,b6
+        jmp fail
+b6:     bbr7 ZP,b7
+        jmp fail
+b7:
+        
+        ; 12: reserved NOPs. Operand bytes are INX, which a NOP of the
+        ; wrong length runs; each NOP is followed by an INY.
+        lda #$0C
+        sta TEST
+        ldx #$00
+        ldy #$00
+        .byte $02,$E8
+        iny
+        .byte $22,$E8
+        iny
+        .byte $42,$E8
+        iny
+        .byte $62,$E8
+        iny
+        .byte $82,$E8
+        iny
+        .byte $C2,$E8
+        iny
+        .byte $E2,$E8
+        iny
+        .byte $44,$E8
+        iny
+        .byte $54,$E8
+        iny
+        .byte $D4,$E8
+        iny
+        .byte $F4,$E8
+        iny
+        .byte $5C,$E8,$E8
+        iny
+        .byte $DC,$E8,$E8
+        iny
+        .byte $FC,$E8,$E8
+        iny
+        .byte $03
+        iny
+        .byte $13
+        iny
+        .byte $23
+        iny
+        .byte $33
+        iny
+        .byte $43
+        iny
+        .byte $53
+        iny
+        .byte $63
+        iny
+        .byte $73
+        iny
+        .byte $83
+        iny
+        .byte $93
+        iny
+        .byte $A3
+        iny
+        .byte $B3
+        iny
+        .byte $C3
+        iny
+        .byte $D3
+        iny
+        .byte $E3
+        iny
+        .byte $F3
+        iny
+        .byte $0B
+        iny
+        .byte $1B
+        iny
+        .byte $2B
+        iny
+        .byte $3B
+        iny
+        .byte $4B
+        iny
+        .byte $5B
+        iny
+        .byte $6B
+        iny
+        .byte $7B
+        iny
+        .byte $8B
+        iny
+        .byte $9B
+        iny
+        .byte $AB
+        iny
+        .byte $BB
+        iny
+        .byte $EB
+        iny
+        .byte $FB
+        iny
+        cpx #$00
+        bne fail4
+        cpy #44
+        bne fail4
+        
+        ; 13: N and Z are valid after decimal ADC and SBC
+        lda #$0D
+        sta TEST
+        sed
+        clc
+        lda #$99
+        adc #$01
+        cld
+        bne fail4
+        bcc fail4
+        bmi fail4
+        sed
+        sec
+        lda #$00
+        sbc #$01
+        cld
+        bcs fail4
+        bpl fail4
+        cmp #$99
+        bne fail4
+        jmp t14
+        
+fail4:  jmp fail
+        
+        ; 14: BRK pushes B and D, and clears D in the handler
+t14:    lda #$0E
+        sta TEST
+        lda #<brk
+        sta $FFFE
+        lda #>brk
+        sta $FFFF
+        lda #$00
+        sta ZP
+        sta ZP+1
+        sed
+        .byte $00
+        .byte $EA
+        cld
+        lda ZP
+        and #$08
+        bne fail4
+        lda ZP+1
+        and #$18
+        cmp #$18
+        bne fail4
+        
+        lda #$00
+        sta TEST
+done:   jmp done
+
+fail:   jmp fail
+
+brk:    php
+        pla
+        sta ZP
+        pla
+        pha
+        sta ZP+1
+        rti
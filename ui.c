@@ -20,6 +20,27 @@
 #include <pthread.h>
 #include "ui.h"
 
+/* Speeds selected in turn by the throttle key */
+static const int _speeds[] = { 1, 2, 4, 8, 0 };
+
+static void _next_speed(struct sdl_ui *ui)
+{
+	int i;
+	
+	for(i = 0; _speeds[i] && _speeds[i] != ui->speed; i++);
+	ui->speed = _speeds[_speeds[i] ? i + 1 : 0];
+}
+
+static void _led_colour(struct sdl_ui *ui, int level)
+{
+	/* From dark red when off to bright red */
+	SDL_SetTextureColorMod(ui->led,
+		0x20 + (0xFF - 0x20) * level / 255,
+		0x10 - 0x10 * level / 255,
+		0x10 - 0x10 * level / 255
+	);
+}
+
 static void _render_ui(struct sdl_ui *ui)
 {
 	SDL_Rect drect, srect;
@@ -78,13 +99,10 @@ static void _render_ui(struct sdl_ui *ui)
 		srect = (SDL_Rect) { i * 48, 0, 48, 64 };
 		drect = (SDL_Rect) { 594 - 48 * 2, 516, srect.w, srect.h };
 		
-		if(ui->msd & (1 << i)) SDL_SetTextureColorMod(ui->led, 0xFF, 0x00, 0x00);
-		else SDL_SetTextureColorMod(ui->led, 0x20, 0x10, 0x10);
-		
+		_led_colour(ui, ui->leds[1][i]);
 		SDL_RenderCopy(ui->renderer, ui->led, &srect, &drect);
 		
-		if(ui->lsd & (1 << i)) SDL_SetTextureColorMod(ui->led, 0xFF, 0x00, 0x00);
-		else SDL_SetTextureColorMod(ui->led, 0x20, 0x10, 0x10);
+		_led_colour(ui, ui->leds[0][i]);
 		
 		drect.x = 594 - 48;
 		SDL_RenderCopy(ui->renderer, ui->led, &srect, &drect);
@@ -115,6 +133,8 @@ static void *_thread(void *arg)
 				case SDLK_w: ui->buttons |= (1 << 1); break;
 				case SDLK_e: ui->buttons |= (1 << 2); break;
 				case SDLK_r: ui->buttons |= (1 << 3); break;
+				case SDLK_t: _next_speed(ui); break;
+				case SDLK_p: ui->paused = !ui->paused; break;
 				}
 				
 				break;
@@ -29,15 +29,21 @@ struct sdl_ui {
 	/* OSD */
 	uint8_t osd[512];
 	
-	/* Digits */
-	uint8_t lsd;
-	uint8_t msd;
+	/* Digits, the brightness of each segment of the least then the
+	 * most significant digit (see leds.h) */
+	uint8_t leds[2][8];
 	
 	/* Buttons */
 	uint8_t buttons;
 	
 	/* TODO: Remote control */
 	
+	/* Emulation speed, multiple of real time or 0 for unlimited */
+	int speed;
+	
+	/* Emulation stopped, by the pause key or a watchpoint */
+	int paused;
+	
 	/* Thread control */
 	pthread_t thread;
 	int done;
@@ -0,0 +1,262 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include <stdio.h>
+#include <string.h>
+#include "watch.h"
+
+static void _hit(struct watch_t *s, int type, uint16_t addr, uint8_t v)
+{
+	int i;
+	
+	if(s->hit)
+	{
+		return;
+	}
+	
+	for(i = 0; i < s->count; i++)
+	{
+		if((s->point[i].type & type) &&
+		   addr >= s->point[i].start &&
+		   addr <= s->point[i].end)
+		{
+			s->hit = type;
+			s->hit_pc = s->cpu->pc;
+			s->hit_addr = addr;
+			s->hit_v = v;
+			return;
+		}
+	}
+}
+
+static uint8_t _watch_read(void *private, uint16_t addr)
+{
+	struct watch_t *s = private;
+	const uint8_t *p = s->orig->rpage[addr >> 8];
+	uint8_t v;
+	
+	v = p ? p[addr & 0xFF] : s->orig->read(s->orig->private, addr);
+	
+	if(s->page[addr >> 8] & WATCH_READ)
+	{
+		_hit(s, WATCH_READ, addr, v);
+	}
+	
+	return(v);
+}
+
+static void _watch_write(void *private, uint16_t addr, uint8_t v)
+{
+	struct watch_t *s = private;
+	uint8_t *p = s->orig->wpage[addr >> 8];
+	
+	if(s->page[addr >> 8] & WATCH_WRITE)
+	{
+		_hit(s, WATCH_WRITE, addr, v);
+	}
+	
+	if(p)
+	{
+		p[addr & 0xFF] = v;
+		return;
+	}
+	
+	s->orig->write(s->orig->private, addr, v);
+}
+
+void watch_init(struct watch_t *s, const char *name)
+{
+	memset(s, 0, sizeof(struct watch_t));
+	s->name = name;
+	s->resume_pc = -1;
+}
+
+static void _update(struct watch_t *s)
+{
+	int i, a;
+	
+	memset(s->pc, 0, sizeof(s->pc));
+	memset(s->page, 0, sizeof(s->page));
+	s->breakpoints = 0;
+	
+	for(i = 0; i < s->count; i++)
+	{
+		if(s->point[i].type & WATCH_EXEC)
+		{
+			s->breakpoints++;
+		}
+		
+		for(a = s->point[i].start; a <= s->point[i].end; a++)
+		{
+			if(s->point[i].type & WATCH_EXEC)
+			{
+				s->pc[a >> 3] |= 1 << (a & 7);
+			}
+			
+			s->page[a >> 8] |= s->point[i].type & (WATCH_READ | WATCH_WRITE);
+		}
+	}
+	
+	if(!s->cpu)
+	{
+		return;
+	}
+	
+	for(i = 0; i < 0x100 && !s->page[i]; i++);
+	
+	if(i == 0x100)
+	{
+		/* No memory watches, give the CPU its own memory back */
+		if(s->orig)
+		{
+			s->cpu->mem = s->orig;
+			s->orig = NULL;
+		}
+		
+		return;
+	}
+	
+	/* Stand in front of the CPU's memory, with the watched
+	 * pages sent through the handlers */
+	if(!s->orig)
+	{
+		s->orig = s->cpu->mem;
+	}
+	
+	s->mem = *s->orig;
+	s->mem.private = s;
+	s->mem.read = &_watch_read;
+	s->mem.write = &_watch_write;
+	
+	for(i = 0; i < 0x100; i++)
+	{
+		if(s->page[i] & WATCH_READ) s->mem.rpage[i] = NULL;
+		if(s->page[i] & WATCH_WRITE) s->mem.wpage[i] = NULL;
+	}
+	
+	s->cpu->mem = &s->mem;
+}
+
+int watch_add(struct watch_t *s, int type, uint16_t start, uint16_t end)
+{
+	if(s->count == WATCH_MAX || end < start)
+	{
+		return(-1);
+	}
+	
+	s->point[s->count].start = start;
+	s->point[s->count].end = end;
+	s->point[s->count].type = type;
+	s->count++;
+	
+	_update(s);
+	
+	return(0);
+}
+
+int watch_remove(struct watch_t *s, int type, uint16_t start, uint16_t end)
+{
+	int i;
+	
+	for(i = 0; i < s->count; i++)
+	{
+		if(s->point[i].type == type &&
+		   s->point[i].start == start &&
+		   s->point[i].end == end)
+		{
+			memmove(&s->point[i], &s->point[i + 1], sizeof(struct watch_point_t) * (s->count - i - 1));
+			s->count--;
+			_update(s);
+			return(0);
+		}
+	}
+	
+	return(-1);
+}
+
+void watch_attach(struct watch_t *s, struct cpu_65c02_t *cpu)
+{
+	s->cpu = cpu;
+	_update(s);
+}
+
+uint8_t watch_peek(struct watch_t *s, uint16_t addr)
+{
+	/* Debugger access, around the watches */
+	struct cpu_memory_t *mem = s->orig ? s->orig : s->cpu->mem;
+	const uint8_t *p = mem->rpage[addr >> 8];
+	
+	return(p ? p[addr & 0xFF] : mem->read(mem->private, addr));
+}
+
+void watch_poke(struct watch_t *s, uint16_t addr, uint8_t v)
+{
+	struct cpu_memory_t *mem = s->orig ? s->orig : s->cpu->mem;
+	uint8_t *p = mem->wpage[addr >> 8];
+	
+	/* Direct read-only pages are ROM, the debugger may patch it */
+	if(!p)
+	{
+		p = mem->rpage[addr >> 8];
+	}
+	
+	if(p)
+	{
+		p[addr & 0xFF] = v;
+		return;
+	}
+	
+	mem->write(mem->private, addr, v);
+}
+
+void watch_clear(struct watch_t *s)
+{
+	/* Carry on without stopping at the same breakpoint again */
+	s->hit = 0;
+	s->resume_pc = s->cpu->pc;
+}
+
+void watch_dump(struct watch_t *s)
+{
+	struct cpu_65c02_t *cpu = s->cpu;
+	char pc[SYMBOLS_TEXT], addr[SYMBOLS_TEXT];
+	
+	symbols_format(s->sym, s->hit_pc, pc);
+	symbols_format(s->sym, s->hit_addr, addr);
+	
+	switch(s->hit)
+	{
+	case WATCH_EXEC:
+		printf("watch: %s: breakpoint at $%04X %s\n", s->name, s->hit_pc, pc);
+		break;
+	
+	case WATCH_READ:
+		printf("watch: %s: read $%04X %s= $%02X at $%04X %s\n", s->name, s->hit_addr, *addr ? strcat(addr, " ") : "", s->hit_v, s->hit_pc, pc);
+		break;
+	
+	case WATCH_WRITE:
+		printf("watch: %s: write $%04X %s= $%02X at $%04X %s\n", s->name, s->hit_addr, *addr ? strcat(addr, " ") : "", s->hit_v, s->hit_pc, pc);
+		break;
+	}
+	
+	printf("watch: %s: PC:%04X %-4s A:%02X X:%02X Y:%02X SP:%02X P:%02X cycle %lu %s\n",
+		s->name, cpu->pc,
+		cpu->mem->rpage[cpu->pc >> 8] ? cpu_65c02_mnemonic(cpu->mem->rpage[cpu->pc >> 8][cpu->pc & 0xFF]) : "",
+		cpu->a, cpu->x, cpu->y, cpu->sp, cpu_65c02_status(cpu), cpu->cycle,
+		symbols_format(s->sym, cpu->pc, pc));
+}
+
@@ -0,0 +1,100 @@
+/* ferguson-srb1-emu                                                     */
+/*=======================================================================*/
+/* Copyright 2023 Philip Heron <phil@sanslogic.co.uk>                    */
+/*                                                                       */
+/* This program is free software: you can redistribute it and/or modify  */
+/* it under the terms of the GNU General Public License as published by  */
+/* the Free Software Foundation, either version 3 of the License, or     */
+/* (at your option) any later version.                                   */
+/*                                                                       */
+/* This program is distributed in the hope that it will be useful,       */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/* GNU General Public License for more details.                          */
+/*                                                                       */
+/* You should have received a copy of the GNU General Public License     */
+/* along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef _WATCH_H
+#define _WATCH_H
+
+#include <stdint.h>
+#include "cpu_65c02.h"
+#include "symbols.h"
+
+#define WATCH_EXEC  (1 << 0)
+#define WATCH_READ  (1 << 1)
+#define WATCH_WRITE (1 << 2)
+
+#define WATCH_MAX 32
+
+struct watch_point_t {
+	uint16_t start;
+	uint16_t end;
+	int type;
+};
+
+struct watch_t {
+	const char *name;
+	struct cpu_65c02_t *cpu;
+	
+	struct watch_point_t point[WATCH_MAX];
+	int count;
+	
+	/* One bit per address with a breakpoint, and the number of
+	 * breakpoints. A breakpoint at resume_pc is passed over once */
+	uint8_t pc[0x10000 / 8];
+	int breakpoints;
+	int resume_pc;
+	
+	/* WATCH_READ / WATCH_WRITE for each page with a watchpoint */
+	uint8_t page[0x100];
+	
+	/* The CPU's own memory, and the copy it uses while there are
+	 * memory watches. The watched pages are not mapped so they
+	 * reach the handlers here. orig is NULL when not in use */
+	struct cpu_memory_t *orig;
+	struct cpu_memory_t mem;
+	
+	/* The first hit since the last watch_clear(), or 0 */
+	int hit;
+	uint16_t hit_pc;
+	uint16_t hit_addr;
+	uint8_t hit_v;
+	
+	/* Optional symbols for the dumps */
+	const struct symbols_t *sym;
+};
+
+extern void watch_init(struct watch_t *s, const char *name);
+extern int watch_add(struct watch_t *s, int type, uint16_t start, uint16_t end);
+extern int watch_remove(struct watch_t *s, int type, uint16_t start, uint16_t end);
+extern void watch_attach(struct watch_t *s, struct cpu_65c02_t *cpu);
+extern uint8_t watch_peek(struct watch_t *s, uint16_t addr);
+extern void watch_poke(struct watch_t *s, uint16_t addr, uint8_t v);
+extern void watch_clear(struct watch_t *s);
+extern void watch_dump(struct watch_t *s);
+
+/* Check for a breakpoint before the next instruction. Returns non-zero
+ * if any watch has been hit */
+static inline int watch_exec(struct watch_t *s)
+{
+	uint16_t pc = s->cpu->pc;
+	
+	if(s->breakpoints)
+	{
+		if((s->pc[pc >> 3] & (1 << (pc & 7))) && pc != s->resume_pc && !s->hit)
+		{
+			s->hit = WATCH_EXEC;
+			s->hit_pc = pc;
+			s->hit_addr = pc;
+		}
+		
+		s->resume_pc = -1;
+	}
+	
+	return(s->hit);
+}
+
+#endif
+